@@ -54,7 +54,9 @@ add_library(autodiff_library
   ${CMAKE_CURRENT_SOURCE_DIR}/example/autodiff_library/BinaryOPNode.cpp
   ${CMAKE_CURRENT_SOURCE_DIR}/example/autodiff_library/Edge.cpp
   ${CMAKE_CURRENT_SOURCE_DIR}/example/autodiff_library/EdgeSet.cpp
+  ${CMAKE_CURRENT_SOURCE_DIR}/example/autodiff_library/FlatTape.cpp
   ${CMAKE_CURRENT_SOURCE_DIR}/example/autodiff_library/Node.cpp
+  ${CMAKE_CURRENT_SOURCE_DIR}/example/autodiff_library/NodePool.cpp
   ${CMAKE_CURRENT_SOURCE_DIR}/example/autodiff_library/OPNode.cpp
   ${CMAKE_CURRENT_SOURCE_DIR}/example/autodiff_library/PNode.cpp
   ${CMAKE_CURRENT_SOURCE_DIR}/example/autodiff_library/Stack.cpp
@@ -64,4 +66,5 @@ add_library(autodiff_library
   ${CMAKE_CURRENT_SOURCE_DIR}/example/autodiff_library/autodiff.cpp
 )
 target_include_directories(autodiff_library PUBLIC ${CMAKE_CURRENT_SOURCE_DIR}/example/autodiff_library)
-target_link_libraries(autodiff_library boost)
+find_package(Threads REQUIRED)
+target_link_libraries(autodiff_library boost Threads::Threads)
@@ -0,0 +1,302 @@
+// Copyright (C) 2016-2018 T. Zachary Laine
+//
+// Distributed under the Boost Software License, Version 1.0. (See
+// accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+//[ aliasing
+#include <boost/yap/yap.hpp>
+
+#include <algorithm>
+#include <cassert>
+#include <vector>
+
+
+// A view of a std::vector whose i-th element is vec[i + offset].  Indices
+// that fall off either end are clamped to the nearest element.
+template <typename T>
+struct shifted_view
+{
+    std::vector<T> const * vec;
+    std::ptrdiff_t offset;
+};
+
+template <typename T>
+shifted_view<T> shifted (std::vector<T> const & vec, std::ptrdiff_t offset)
+{ return shifted_view<T>{&vec, offset}; }
+
+// A view of a std::vector whose i-th element is vec[indices[i]].
+template <typename T>
+struct gathered_view
+{
+    std::vector<T> const * vec;
+    std::vector<std::size_t> const * indices;
+};
+
+template <typename T>
+gathered_view<T> gathered (std::vector<T> const & vec, std::vector<std::size_t> const & indices)
+{ return gathered_view<T>{&vec, &indices}; }
+
+
+// Turns each std::vector or view terminal into a terminal containing its n-th
+// element.
+struct take_nth
+{
+    template <typename T>
+    auto operator() (boost::yap::expr_tag<boost::yap::expr_kind::terminal>,
+                     std::vector<T> const & vec)
+    { return boost::yap::make_terminal(vec[n]); }
+
+    template <typename T>
+    auto operator() (boost::yap::expr_tag<boost::yap::expr_kind::terminal>,
+                     shifted_view<T> view)
+    {
+        std::ptrdiff_t const last = view.vec->size() - 1;
+        std::ptrdiff_t const i = std::min(
+            std::max(static_cast<std::ptrdiff_t>(n) + view.offset, std::ptrdiff_t(0)),
+            last);
+        return boost::yap::make_terminal((*view.vec)[i]);
+    }
+
+    template <typename T>
+    auto operator() (boost::yap::expr_tag<boost::yap::expr_kind::terminal>,
+                     gathered_view<T> view)
+    { return boost::yap::make_terminal((*view.vec)[(*view.indices)[n]]); }
+
+    std::size_t n;
+};
+
+template <typename Expr>
+decltype(auto) evaluate_nth (Expr const & expr, std::size_t n)
+{
+    return boost::yap::evaluate(
+        boost::yap::transform(boost::yap::as_expr(expr), take_nth{n}));
+}
+
+
+// How writing the i-th element of the destination while evaluating the
+// right-hand side elementwise interacts with the reads the right-hand side
+// makes from the destination.
+enum class aliasing {
+    in_place_forward,  // No reads from the destination behind element i.
+    in_place_backward, // No reads from the destination ahead of element i.
+    needs_scratch      // Reads from both directions, or from anywhere.
+};
+
+// A stateful transform that compares the address of the storage of each
+// terminal with that of the destination.  Reading the destination through a
+// plain std::vector terminal is always harmless, since element i is read
+// before element i is written, and no other element is ever read.
+struct aliasing_impl
+{
+    template <typename T>
+    auto operator() (boost::yap::expr_tag<boost::yap::expr_kind::terminal>,
+                     shifted_view<T> view)
+    {
+        if (aliases(*view.vec)) {
+            if (view.offset < 0)
+                reads_behind = true;
+            else if (0 < view.offset)
+                reads_ahead = true;
+        }
+        return 0;
+    }
+
+    template <typename T>
+    auto operator() (boost::yap::expr_tag<boost::yap::expr_kind::terminal>,
+                     gathered_view<T> view)
+    {
+        if (aliases(*view.vec) || aliases(*view.indices))
+            reads_anywhere = true;
+        return 0;
+    }
+
+    template <typename T>
+    bool aliases (std::vector<T> const & vec) const
+    { return !vec.empty() && static_cast<void const *>(vec.data()) == dest; }
+
+    void const * dest;
+    bool reads_behind;
+    bool reads_ahead;
+    bool reads_anywhere;
+};
+
+template <typename T, typename Expr>
+aliasing classify_aliasing (std::vector<T> const & vec, Expr const & expr)
+{
+    aliasing_impl impl{vec.data(), false, false, false};
+    boost::yap::transform(boost::yap::as_expr(expr), impl);
+    if (impl.reads_anywhere || (impl.reads_behind && impl.reads_ahead))
+        return aliasing::needs_scratch;
+    if (impl.reads_behind)
+        return aliasing::in_place_backward;
+    return aliasing::in_place_forward;
+}
+
+
+// Evaluates e elementwise, and calls op() on each element of vec with the
+// corresponding result.  The destination is only copied when its aliasing
+// with e requires it; otherwise e is evaluated in place, walking vec in
+// whichever direction only reads elements that have not yet been written.
+template <typename T, typename Expr, typename Op>
+std::vector<T> & op_assign (std::vector<T> & vec, Expr const & e, Op && op)
+{
+    decltype(auto) expr = boost::yap::as_expr(e);
+    std::size_t const size = vec.size();
+    switch (classify_aliasing(vec, expr)) {
+    case aliasing::in_place_forward:
+        for (std::size_t i = 0; i < size; ++i) {
+            op(vec[i], evaluate_nth(expr, i));
+        }
+        break;
+    case aliasing::in_place_backward:
+        for (std::size_t i = size; i-- > 0;) {
+            op(vec[i], evaluate_nth(expr, i));
+        }
+        break;
+    case aliasing::needs_scratch: {
+        using value_type = std::decay_t<decltype(evaluate_nth(expr, 0))>;
+        std::vector<value_type> scratch;
+        scratch.reserve(size);
+        for (std::size_t i = 0; i < size; ++i) {
+            scratch.push_back(evaluate_nth(expr, i));
+        }
+        for (std::size_t i = 0; i < size; ++i) {
+            op(vec[i], std::move(scratch[i]));
+        }
+        break;
+    }
+    }
+    return vec;
+}
+
+template <typename T, typename Expr>
+std::vector<T> & assign (std::vector<T> & vec, Expr const & expr)
+{
+    return op_assign(vec, expr, [](auto & vec_value, auto && expr_value) {
+        vec_value = std::forward<decltype(expr_value)>(expr_value);
+    });
+}
+
+template <typename T, typename Expr>
+std::vector<T> & plus_assign (std::vector<T> & vec, Expr const & expr)
+{
+    return op_assign(vec, expr, [](auto & vec_value, auto && expr_value) {
+        vec_value += std::forward<decltype(expr_value)>(expr_value);
+    });
+}
+
+// operator+=() comes in two overloads.  The second takes an expression, and
+// is needed because it is a better match than the expression-building
+// operator+=() that YAP provides for expression right-hand sides.
+template <typename T, typename U>
+std::vector<T> & operator+= (std::vector<T> & vec, U const & u)
+{ return plus_assign(vec, u); }
+
+template <typename T, boost::yap::expr_kind Kind, typename Tuple>
+std::vector<T> & operator+= (std::vector<T> & vec,
+                             boost::yap::expression<Kind, Tuple> && expr)
+{ return plus_assign(vec, expr); }
+
+
+// A type trait that identifies std::vectors and views of them.
+template <typename T>
+struct is_vector_or_view : std::false_type {};
+
+template <typename T, typename A>
+struct is_vector_or_view<std::vector<T, A>> : std::true_type {};
+
+template <typename T>
+struct is_vector_or_view<shifted_view<T>> : std::true_type {};
+
+template <typename T>
+struct is_vector_or_view<gathered_view<T>> : std::true_type {};
+
+BOOST_YAP_USER_UDT_UNARY_OPERATOR(negate, boost::yap::expression, is_vector_or_view); // -
+BOOST_YAP_USER_UDT_ANY_BINARY_OPERATOR(multiplies, boost::yap::expression, is_vector_or_view); // *
+BOOST_YAP_USER_UDT_ANY_BINARY_OPERATOR(divides, boost::yap::expression, is_vector_or_view); // /
+BOOST_YAP_USER_UDT_ANY_BINARY_OPERATOR(plus, boost::yap::expression, is_vector_or_view); // +
+BOOST_YAP_USER_UDT_ANY_BINARY_OPERATOR(minus, boost::yap::expression, is_vector_or_view); // -
+BOOST_YAP_USER_UDT_ANY_BINARY_OPERATOR(less, boost::yap::expression, is_vector_or_view); // <
+BOOST_YAP_USER_UDT_ANY_BINARY_OPERATOR(greater, boost::yap::expression, is_vector_or_view); // >
+
+int main ()
+{
+    {
+        std::vector<double> v1(4, 1.0);
+        std::vector<double> const v2(4, 2.0);
+
+        // v1 is only read at the index being written, so this is evaluated in
+        // place.
+        assert(classify_aliasing(v1, v2 - v1) == aliasing::in_place_forward);
+        v1 += v2 - v1;
+        assert(v1 == std::vector<double>(4, 2.0));
+    }
+
+    {
+        std::vector<int> a = {0, 10, 20, 30, 40};
+        std::vector<int> const b = {1, 1, 1, 1, 1};
+        std::vector<int> const c = {2, 2, 2, 2, 2};
+
+        assert(
+            classify_aliasing(a, if_else(a < 30, b, c)) ==
+            aliasing::in_place_forward);
+        a += if_else(a < 30, b, c);
+        assert(a == std::vector<int>({1, 11, 21, 32, 42}));
+    }
+
+    {
+        // Each element reads its right neighbor, which has not been
+        // overwritten yet if we walk forward.
+        std::vector<int> v = {1, 2, 3, 4, 5};
+        assert(
+            classify_aliasing(v, shifted(v, 1) * 10) ==
+            aliasing::in_place_forward);
+        assign(v, shifted(v, 1) * 10);
+        assert(v == std::vector<int>({20, 30, 40, 50, 50}));
+    }
+
+    {
+        // Each element reads its left neighbor, which has not been
+        // overwritten yet if we walk backward.
+        std::vector<int> v = {1, 2, 3, 4, 5};
+        assert(
+            classify_aliasing(v, shifted(v, -1) + v) ==
+            aliasing::in_place_backward);
+        assign(v, shifted(v, -1) + v);
+        assert(v == std::vector<int>({2, 3, 5, 7, 9}));
+    }
+
+    {
+        // A three-point stencil reads both neighbors, so it is evaluated into
+        // a scratch buffer first.
+        std::vector<double> v = {0.0, 3.0, 6.0, 3.0, 0.0};
+        assert(
+            classify_aliasing(v, (shifted(v, -1) + shifted(v, 1)) / 2.0) ==
+            aliasing::needs_scratch);
+        assign(v, (shifted(v, -1) + shifted(v, 1)) / 2.0);
+        assert(v == std::vector<double>({1.5, 3.0, 3.0, 3.0, 1.5}));
+
+        // The same stencil reading from a different vector needs no scratch
+        // buffer.
+        std::vector<double> const u = {0.0, 3.0, 6.0, 3.0, 0.0};
+        assert(
+            classify_aliasing(v, (shifted(u, -1) + shifted(u, 1)) / 2.0) ==
+            aliasing::in_place_forward);
+        assign(v, (shifted(u, -1) + shifted(u, 1)) / 2.0);
+        assert(v == std::vector<double>({1.5, 3.0, 3.0, 3.0, 1.5}));
+    }
+
+    {
+        // A permutation of the destination may read from anywhere.
+        std::vector<int> p = {10, 20, 30, 40};
+        std::vector<std::size_t> const reverse = {3, 2, 1, 0};
+        assert(
+            classify_aliasing(p, gathered(p, reverse)) ==
+            aliasing::needs_scratch);
+        assign(p, gathered(p, reverse));
+        assert(p == std::vector<int>({40, 30, 20, 10}));
+    }
+
+    return 0;
+}
+//]
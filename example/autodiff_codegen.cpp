@@ -0,0 +1,68 @@
+// Copyright (C) 2016-2018 T. Zachary Laine
+//
+// Distributed under the Boost Software License, Version 1.0. (See
+// accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+#include "autodiff.h"
+#include "autodiff_expr.hpp"
+#include "FlatTape.h"
+
+#include <fstream>
+#include <iostream>
+
+#include <boost/yap/algorithm.hpp>
+
+
+using namespace AutoDiff;
+
+//[ autodiff_codegen
+// Builds the Node graph of expr, lowers it onto a FlatTape, and writes the
+// tape out as a function with the given name.  The graph only exists while
+// this program runs; the function it writes needs no Autodiff at all.
+template <typename Expr>
+void emit (std::ostream & os, Expr const & expr, std::string const & name, bool hessian)
+{
+    vector<Node *> list;
+    Node * root = boost::yap::transform(expr, xform{list});
+    FlatTape tape;
+    flat_tape(root, list, tape);
+    tape.emit_cpp(os, name, hessian);
+    os << "\n";
+}
+
+// Writes the derivative kernels of the functions that are fixed at build
+// time to the header named on the command line.
+int main (int argc, char * argv[])
+{
+    if (argc != 2) {
+        std::cerr << "usage: autodiff_codegen <output header>\n";
+        return 1;
+    }
+
+    autodiff_setup();
+
+    std::ofstream ofs(argv[1]);
+    ofs << "// Generated by autodiff_codegen; do not edit.\n"
+        << "#ifndef AUTODIFF_KERNELS_HPP_\n"
+        << "#define AUTODIFF_KERNELS_HPP_\n"
+        << "\n"
+        << "#include <cmath>\n"
+        << "\n";
+
+    using namespace autodiff_placeholders;
+    // f(x1,x2,x3) = -5*x1+sin(10)*x1+10*x2-x3/6
+    emit(ofs, -5 * 1_p + sin_(10) * 1_p + 10 * 2_p - 3_p / 6,
+         "linear_fun1_kernel", false);
+    // f(x1,x2,x3,x4) = (x1*x2 * sin(x1))/x3 + x2*x4 - x1/x2
+    emit(ofs, (1_p * 2_p * sin_(1_p)) / 3_p + 2_p * 4_p - 1_p / 2_p,
+         "nl_function1_kernel", true);
+    emit(ofs, sqrt_(1_p * 1_p * 1_p * 1_p) - cos_(-2_p) / 1_p,
+         "unary_function_kernel", true);
+
+    ofs << "#endif\n";
+
+    autodiff_cleanup();
+
+    return ofs ? 0 : 1;
+}
+//]
@@ -4,12 +4,19 @@
 // accompanying file LICENSE_1_0.txt or copy at
 // http://www.boost.org/LICENSE_1_0.txt)
 #include "autodiff.h"
+#include "autodiff_expr.hpp"
+#include "FlatTape.h"
+#include "autodiff_kernels.hpp"
 
+#include <array>
 #include <iostream>
+#include <thread>
 
 #include <boost/yap/algorithm.hpp>
 #include <boost/polymorphic_cast.hpp>
 #include <boost/hana/for_each.hpp>
+#include <boost/hana/integral_constant.hpp>
+#include <boost/hana/max.hpp>
 
 #define BOOST_TEST_MODULE autodiff_test
 #include <boost/test/included/unit_test.hpp>
@@ -20,148 +27,326 @@ double const Epsilon = 10.0e-6;
 
 using namespace AutoDiff;
 
-//[ autodiff_expr_template_decl
-template <boost::yap::expr_kind Kind, typename Tuple>
-struct autodiff_expr
+//[ autodiff_to_node
+template <typename Expr, typename ...T>
+Node * to_auto_diff_node (Expr const & expr, vector<Node *> & list, T ... args)
 {
-    static boost::yap::expr_kind const kind = Kind;
-
-    Tuple elements;
-};
-
-BOOST_YAP_USER_UNARY_OPERATOR(negate, autodiff_expr, autodiff_expr)
+    Node * retval = nullptr;
 
-BOOST_YAP_USER_BINARY_OPERATOR(plus, autodiff_expr, autodiff_expr)
-BOOST_YAP_USER_BINARY_OPERATOR(minus, autodiff_expr, autodiff_expr)
-BOOST_YAP_USER_BINARY_OPERATOR(multiplies, autodiff_expr, autodiff_expr)
-BOOST_YAP_USER_BINARY_OPERATOR(divides, autodiff_expr, autodiff_expr)
-//]
+    // This fills in list as a side effect.
+    retval = boost::yap::transform(expr, xform{list});
 
-//[ autodiff_expr_literals_decl
-namespace autodiff_placeholders {
+    assert(list.size() == sizeof...(args));
 
-    // This defines a placeholder literal operator that creates autodiff_expr
-    // placeholders.
-    BOOST_YAP_USER_LITERAL_PLACEHOLDER_OPERATOR(autodiff_expr)
+    // Fill in the values of the value-nodes in list with the "args"
+    // parameter pack.
+    auto it = list.begin();
+    boost::hana::for_each(
+        boost::hana::make_tuple(args ...),
+        [&it](auto x) {
+            Node * n = *it;
+            VNode * v = boost::polymorphic_downcast<VNode *>(n);
+            v->val = x;
+            ++it;
+        }
+    );
 
+    return retval;
 }
 //]
 
-//[ autodiff_function_terminals
-template <OPCODE Opcode>
-struct autodiff_fn_expr :
-    autodiff_expr<boost::yap::expr_kind::terminal, boost::hana::tuple<OPCODE>>
+//[ autodiff_flat_xform
+// Lowers an expression directly onto a FlatTape, without creating any Nodes.
+// Each transform overload returns the index of the tape entry it added.
+struct flat_xform
 {
-    autodiff_fn_expr () :
-        autodiff_expr {boost::hana::tuple<OPCODE>{Opcode}}
-    {}
-
-    BOOST_YAP_USER_CALL_OPERATOR_N(::autodiff_expr, 1);
-};
-
-// Someone included <math.h>, so we have to add trailing underscores.
-autodiff_fn_expr<OP_SIN> const sin_;
-autodiff_fn_expr<OP_COS> const cos_;
-autodiff_fn_expr<OP_SQRT> const sqrt_;
-//]
-
-//[ autodiff_xform
-struct xform
-{
-    // Create a var-node for each placeholder when we see it for the first
-    // time.
+    // Add a variable entry for each placeholder when we see it for the first
+    // time, and reuse it afterward.
     template <long long I>
-    Node * operator() (boost::yap::expr_tag<boost::yap::expr_kind::terminal>,
-                       boost::yap::placeholder<I>)
+    unsigned int operator() (boost::yap::expr_tag<boost::yap::expr_kind::terminal>,
+                             boost::yap::placeholder<I>)
     {
-        if (list_.size() < I)
-            list_.resize(I);
-        auto & retval = list_[I - 1];
-        if (retval == nullptr)
-            retval = create_var_node();
+        if (vars_.size() < I)
+            vars_.resize(I, FlatTape::NONE);
+        auto & retval = vars_[I - 1];
+        if (retval == FlatTape::NONE)
+            retval = tape_.add_var(I - 1);
         return retval;
     }
 
-    // Create a param-node for every numeric terminal in the expression.
-    Node * operator() (boost::yap::expr_tag<boost::yap::expr_kind::terminal>, double x)
-    { return create_param_node(x); }
+    unsigned int operator() (boost::yap::expr_tag<boost::yap::expr_kind::terminal>, double x)
+    { return tape_.add_param(x); }
 
-    // Create a "uary" node for each call expression, using its OPCODE.
     template <typename Expr>
-    Node * operator() (boost::yap::expr_tag<boost::yap::expr_kind::call>,
-                       OPCODE opcode, Expr const & expr)
+    unsigned int operator() (boost::yap::expr_tag<boost::yap::expr_kind::call>,
+                             OPCODE opcode, Expr const & expr)
     {
-        return create_uary_op_node(
+        return tape_.add_op(
             opcode,
             boost::yap::transform(boost::yap::as_expr<autodiff_expr>(expr), *this)
         );
     }
 
     template <typename Expr>
-    Node * operator() (boost::yap::expr_tag<boost::yap::expr_kind::negate>,
-                       Expr const & expr)
+    unsigned int operator() (boost::yap::expr_tag<boost::yap::expr_kind::negate>,
+                             Expr const & expr)
     {
-        return create_uary_op_node(
+        return tape_.add_op(
             OP_NEG,
             boost::yap::transform(boost::yap::as_expr<autodiff_expr>(expr), *this)
         );
     }
 
-    // Define a mapping from binary arithmetic expr_kind to OPCODE...
-    static OPCODE op_for_kind (boost::yap::expr_kind kind)
+    template <boost::yap::expr_kind Kind, typename Expr1, typename Expr2>
+    unsigned int operator() (boost::yap::expr_tag<Kind>, Expr1 const & expr1, Expr2 const & expr2)
     {
-        switch (kind) {
-        case boost::yap::expr_kind::plus: return OP_PLUS;
-        case boost::yap::expr_kind::minus: return OP_MINUS;
-        case boost::yap::expr_kind::multiplies: return OP_TIMES;
-        case boost::yap::expr_kind::divides: return OP_DIVID;
-        default: assert(!"This should never execute"); return OPCODE{};
-        }
-        assert(!"This should never execute");
-        return OPCODE{};
+        unsigned int const left =
+            boost::yap::transform(boost::yap::as_expr<autodiff_expr>(expr1), *this);
+        unsigned int const right =
+            boost::yap::transform(boost::yap::as_expr<autodiff_expr>(expr2), *this);
+        return tape_.add_op(xform::op_for_kind(Kind), left, right);
     }
 
-    // ... and use it to handle all the binary arithmetic operators.
+    FlatTape & tape_;
+    vector<unsigned int> vars_;
+};
+
+template <typename Expr>
+FlatTape to_flat_tape (Expr const & expr)
+{
+    FlatTape retval;
+    boost::yap::transform(expr, flat_xform{retval, {}});
+    return retval;
+}
+//]
+
+//[ autodiff_gradient
+// The results of the forward sweep of gradient().  Each holds the value of a
+// subexpression and the partial derivatives of that value with respect to
+// its operands, alongside the results for the operands themselves.  The
+// shape of the whole structure is known at compile time.
+template <long long I>
+struct var_value
+{
+    double value;
+};
+
+struct param_value
+{
+    double value;
+};
+
+template <typename Operand>
+struct unary_value
+{
+    double value;
+    double partial;
+    Operand operand;
+};
+
+template <typename Left, typename Right>
+struct binary_value
+{
+    double value;
+    double left_partial;
+    double right_partial;
+    Left left;
+    Right right;
+};
+
+// Finds the highest placeholder index in an expression, as an integral
+// constant.
+struct max_placeholder
+{
+    template <long long I>
+    auto operator() (boost::yap::expr_tag<boost::yap::expr_kind::terminal>,
+                     boost::yap::placeholder<I>)
+    { return boost::hana::llong_c<I>; }
+
+    auto operator() (boost::yap::expr_tag<boost::yap::expr_kind::terminal>, double)
+    { return boost::hana::llong_c<0>; }
+
+    template <typename Expr>
+    auto operator() (boost::yap::expr_tag<boost::yap::expr_kind::call>,
+                     OPCODE, Expr const & expr)
+    { return boost::yap::transform(boost::yap::as_expr<autodiff_expr>(expr), *this); }
+
+    template <typename Expr>
+    auto operator() (boost::yap::expr_tag<boost::yap::expr_kind::negate>,
+                     Expr const & expr)
+    { return boost::yap::transform(boost::yap::as_expr<autodiff_expr>(expr), *this); }
+
     template <boost::yap::expr_kind Kind, typename Expr1, typename Expr2>
-    Node * operator() (boost::yap::expr_tag<Kind>, Expr1 const & expr1, Expr2 const & expr2)
+    auto operator() (boost::yap::expr_tag<Kind>, Expr1 const & expr1, Expr2 const & expr2)
     {
-        return create_binary_op_node(
-            op_for_kind(Kind),
+        return boost::hana::max(
             boost::yap::transform(boost::yap::as_expr<autodiff_expr>(expr1), *this),
             boost::yap::transform(boost::yap::as_expr<autodiff_expr>(expr2), *this)
         );
     }
+};
 
-    vector<Node *> & list_;
+// The forward sweep: evaluates each subexpression once, recording its value
+// and local partials.
+template <std::size_t N>
+struct gradient_forward
+{
+    template <long long I>
+    var_value<I> operator() (boost::yap::expr_tag<boost::yap::expr_kind::terminal>,
+                             boost::yap::placeholder<I>)
+    { return var_value<I>{args_[I - 1]}; }
+
+    param_value operator() (boost::yap::expr_tag<boost::yap::expr_kind::terminal>, double x)
+    { return param_value{x}; }
+
+    template <typename Expr>
+    auto operator() (boost::yap::expr_tag<boost::yap::expr_kind::call>,
+                     OPCODE opcode, Expr const & expr)
+    {
+        auto operand =
+            boost::yap::transform(boost::yap::as_expr<autodiff_expr>(expr), *this);
+        double const x = operand.value;
+        switch (opcode) {
+        case OP_SIN: return make_unary(sin(x), cos(x), operand);
+        case OP_COS: return make_unary(cos(x), -sin(x), operand);
+        case OP_SQRT: return make_unary(sqrt(x), 0.5 / sqrt(x), operand);
+        default: assert(!"This should never execute");
+        }
+        return make_unary(NaN_Double, NaN_Double, operand);
+    }
+
+    template <typename Expr>
+    auto operator() (boost::yap::expr_tag<boost::yap::expr_kind::negate>,
+                     Expr const & expr)
+    {
+        auto operand =
+            boost::yap::transform(boost::yap::as_expr<autodiff_expr>(expr), *this);
+        return make_unary(-operand.value, -1.0, operand);
+    }
+
+    template <boost::yap::expr_kind Kind, typename Expr1, typename Expr2>
+    auto operator() (boost::yap::expr_tag<Kind>, Expr1 const & expr1, Expr2 const & expr2)
+    {
+        auto left =
+            boost::yap::transform(boost::yap::as_expr<autodiff_expr>(expr1), *this);
+        auto right =
+            boost::yap::transform(boost::yap::as_expr<autodiff_expr>(expr2), *this);
+        double const l = left.value;
+        double const r = right.value;
+        using result_type = binary_value<decltype(left), decltype(right)>;
+        switch (Kind) {
+        case boost::yap::expr_kind::plus: return result_type{l + r, 1.0, 1.0, left, right};
+        case boost::yap::expr_kind::minus: return result_type{l - r, 1.0, -1.0, left, right};
+        case boost::yap::expr_kind::multiplies: return result_type{l * r, r, l, left, right};
+        case boost::yap::expr_kind::divides: return result_type{l / r, 1.0 / r, -l / (r * r), left, right};
+        default: assert(!"This should never execute");
+        }
+        return result_type{NaN_Double, NaN_Double, NaN_Double, left, right};
+    }
+
+    template <typename Operand>
+    static unary_value<Operand> make_unary (double value, double partial, Operand operand)
+    { return unary_value<Operand>{value, partial, operand}; }
+
+    std::array<double, N> const & args_;
 };
-//]
 
-//[ autodiff_to_node
-template <typename Expr, typename ...T>
-Node * to_auto_diff_node (Expr const & expr, vector<Node *> & list, T ... args)
+// The reverse sweep: propagates adjoints from the root down to the
+// variables, reusing the values recorded by the forward sweep.
+template <long long I, std::size_t N>
+void backprop (var_value<I> const &, double adjoint, std::array<double, N> & grad)
+{ grad[I - 1] += adjoint; }
+
+template <std::size_t N>
+void backprop (param_value const &, double, std::array<double, N> &)
+{}
+
+template <typename Operand, std::size_t N>
+void backprop (unary_value<Operand> const & v, double adjoint, std::array<double, N> & grad)
+{ backprop(v.operand, adjoint * v.partial, grad); }
+
+template <typename Left, typename Right, std::size_t N>
+void backprop (binary_value<Left, Right> const & v, double adjoint, std::array<double, N> & grad)
 {
-    Node * retval = nullptr;
+    backprop(v.left, adjoint * v.left_partial, grad);
+    backprop(v.right, adjoint * v.right_partial, grad);
+}
 
-    // This fills in list as a side effect.
-    retval = boost::yap::transform(expr, xform{list});
+template <std::size_t N>
+struct value_and_gradient
+{
+    double value;
+    std::array<double, N> grad;
+};
+
+// A function object that evaluates Expr and its partial derivatives with
+// respect to each of its N placeholders.  No graph or tape is built, and
+// nothing is allocated; both sweeps are unrolled into straight-line code at
+// compile time.
+template <typename Expr>
+struct gradient_fn
+{
+    static constexpr std::size_t N = decltype(boost::yap::transform(
+        std::declval<Expr const &>(), max_placeholder{}))::value;
+
+    template <typename ...T>
+    value_and_gradient<N> operator() (T ... args) const
+    {
+        static_assert(sizeof...(T) == N, "Wrong number of arguments.");
+        std::array<double, N> const x = {{static_cast<double>(args)...}};
+        auto const forward = boost::yap::transform(expr_, gradient_forward<N>{x});
+        value_and_gradient<N> retval = {forward.value, {}};
+        backprop(forward, 1.0, retval.grad);
+        return retval;
+    }
+
+    Expr expr_;
+};
+
+template <typename Expr>
+gradient_fn<Expr> gradient (Expr const & expr)
+{ return gradient_fn<Expr>{expr}; }
+//]
+
+//[ autodiff_jacobian
+// Builds the Node graphs of a tuple of expressions with a single xform, so
+// that they share their variables.  Since Node creation is hash-consed, they
+// share any subexpressions they have in common, too.
+template <typename ...Exprs, typename ...T>
+vector<Node *> to_auto_diff_nodes (boost::hana::tuple<Exprs...> const & exprs,
+                                   vector<Node *> & list, T ... args)
+{
+    vector<Node *> retval;
+    xform x{list};
+    boost::hana::for_each(exprs, [&retval, &x](auto const & expr) {
+        retval.push_back(boost::yap::transform(expr, x));
+    });
 
     assert(list.size() == sizeof...(args));
 
-    // Fill in the values of the value-nodes in list with the "args"
-    // parameter pack.
     auto it = list.begin();
     boost::hana::for_each(
         boost::hana::make_tuple(args ...),
         [&it](auto x) {
-            Node * n = *it;
-            VNode * v = boost::polymorphic_downcast<VNode *>(n);
-            v->val = x;
+            boost::polymorphic_downcast<VNode *>(*it)->val = x;
             ++it;
         }
     );
 
     return retval;
 }
+
+// Evaluates a vector valued function given as a tuple of expressions, and
+// adds its Jacobian to jac.  All the outputs are differentiated together on
+// one tape.
+template <typename ...Exprs, typename ...T>
+void jacobian (boost::hana::tuple<Exprs...> const & exprs,
+               vector<double> & vals, col_compress_matrix & jac, T ... args)
+{
+    vector<Node *> list;
+    vector<Node *> roots = to_auto_diff_nodes(exprs, list, args...);
+    AutoDiff::jacobian(roots, list, vals, jac);
+}
 //]
 
 struct F{
@@ -696,6 +881,56 @@ BOOST_AUTO_TEST_CASE( test_hess_reverse_7)
 	}
 }
 
+BOOST_AUTO_TEST_CASE( test_hess_reverse_full)
+{
+	vector<Node*> nodes;
+	Node* root = build_nl_function1(nodes);
+	double eval = eval_function(root);
+
+	double hx[4][4] ={
+		{-1.747958066718855, -0.657091724418110,  2.410459188139686, 0},
+		{-0.657091724418110,  0.006806564792590, -0.289815306593997, 1},
+		{ 2.410459188139686, -0.289815306593997,  2.064383410399700, 0},
+		{0, 1, 0, 0}
+	};
+	//one direction per sweep, a partial last block, and all directions in one sweep
+	unsigned int blocks[] = {1,3,FlatTape::HESS_BLOCK};
+	for(unsigned int b=0;b<3;b++)
+	{
+		col_compress_matrix hess(nodes.size(),nodes.size());
+		double hval = hess_reverse(root,nodes,hess,blocks[b]);
+		CHECK_CLOSE(hval,eval);
+		const col_compress_matrix& chess = hess;
+		for(unsigned int i=0;i<nodes.size();i++)
+		{
+			for(unsigned int j=0;j<nodes.size();j++)
+			{
+				CHECK_CLOSE(chess(i,j),hx[i][j]);
+			}
+		}
+		//exact zeros are not stored
+		BOOST_CHECK_EQUAL(hess.nnz(),11);
+	}
+
+	col_compress_matrix shess(nodes.size(),nodes.size());
+	double sval = hess_reverse_sparse(root,nodes,shess);
+	CHECK_CLOSE(sval,eval);
+	const col_compress_matrix& cshess = shess;
+	for(unsigned int i=0;i<nodes.size();i++)
+	{
+		for(unsigned int j=0;j<nodes.size();j++)
+		{
+			CHECK_CLOSE(cshess(i,j),hx[i][j]);
+		}
+	}
+	BOOST_CHECK_EQUAL(shess.nnz(),11);
+
+	FlatTape tape;
+	unsigned int entry = flat_tape(root,nodes,tape);
+	BOOST_CHECK_EQUAL(entry,tape.size()-1);
+	BOOST_CHECK_EQUAL(tape.size(),12);
+}
+
 #if FORWARD_ENABLED
 void test_hess_forward(Node* root, unsigned int& nvar)
 {
@@ -849,4 +1084,547 @@ BOOST_AUTO_TEST_CASE( test_grad_reverse13)
 	CHECK_CLOSE(grad[1],0.090901);
 }
 
+// Checks a FlatTape's value and gradient at x against those of the
+// equivalent Node graph, whose variables are in list.
+void check_flat_tape(FlatTape& tape, Node* root, vector<Node*>& list, vector<double> const& x)
+{
+	BOOST_CHECK_EQUAL(tape.nvars(),list.size());
+	for(unsigned int i=0;i<list.size();i++){
+		boost::polymorphic_downcast<VNode*>(list[i])->val = x[i];
+	}
+	vector<double> grad;
+	double val = grad_reverse(root,list,grad);
+	vector<double> flat_grad(tape.nvars());
+	CHECK_CLOSE(tape.eval_function(x.data()),val);
+	CHECK_CLOSE(tape.grad_reverse(x.data(),flat_grad.data()),val);
+	for(unsigned int i=0;i<grad.size();i++){
+		CHECK_CLOSE(flat_grad[i],grad[i]);
+	}
+}
+
+BOOST_AUTO_TEST_CASE( test_flat_tape_linear_fun1)
+{
+	using namespace autodiff_placeholders;
+	vector<Node*> list;
+	Node* root = build_linear_fun1(list);
+	FlatTape tape = to_flat_tape(-5 * 1_p + sin_(10) * 1_p + 10 * 2_p - 3_p / 6);
+	check_flat_tape(tape,root,list,{-1.9,2,5./6.});
+}
+
+BOOST_AUTO_TEST_CASE( test_flat_tape_nl_function1)
+{
+	using namespace autodiff_placeholders;
+	vector<Node*> list;
+	Node* root = build_nl_function1(list);
+	FlatTape tape = to_flat_tape((1_p * 2_p * sin_(1_p)) / 3_p + 2_p * 4_p - 1_p / 2_p);
+	// 8 operations and 4 variables; unlike the Node graph's 16 nodes, each
+	// variable appears once no matter how many times it is used.
+	BOOST_CHECK_EQUAL(tape.size(),12);
+	check_flat_tape(tape,root,list,{-1.23,7.1231,2,-10});
+	check_flat_tape(tape,root,list,{0.5,-2,3,4});
+}
+
+BOOST_AUTO_TEST_CASE( test_flat_tape_unary)
+{
+	using namespace autodiff_placeholders;
+	auto expr = sqrt_(1_p * 1_p * 1_p * 1_p) - cos_(-2_p) / 1_p;
+	vector<Node*> list;
+	Node* root = to_auto_diff_node(expr,list,1.5,0.25);
+	FlatTape tape = to_flat_tape(expr);
+	check_flat_tape(tape,root,list,{1.5,0.25});
+}
+
+// Checks the value and gradient computed by gradient() against those of the
+// equivalent Node graph, whose variables are in list.
+template <typename Expr, typename ...T>
+void check_gradient(Expr const& expr, T ... args)
+{
+	vector<Node*> list;
+	Node* root = to_auto_diff_node(expr,list,args...);
+	vector<double> grad;
+	double val = grad_reverse(root,list,grad);
+	auto result = gradient(expr)(args...);
+	BOOST_CHECK_EQUAL(result.grad.size(),grad.size());
+	CHECK_CLOSE(result.value,val);
+	for(unsigned int i=0;i<grad.size();i++){
+		CHECK_CLOSE(result.grad[i],grad[i]);
+	}
+}
+
+BOOST_AUTO_TEST_CASE( test_gradient)
+{
+	using namespace autodiff_placeholders;
+	check_gradient(-5 * 1_p + sin_(10) * 1_p + 10 * 2_p - 3_p / 6,-1.9,2,5./6.);
+	check_gradient((1_p * 2_p * sin_(1_p)) / 3_p + 2_p * 4_p - 1_p / 2_p,-1.23,7.1231,2,-10);
+	check_gradient(sqrt_(1_p * 1_p * 1_p * 1_p) - cos_(-2_p) / 1_p,1.5,0.25);
+
+	static_assert(decltype(gradient(1_p * 3_p))::N == 3, "");
+	auto result = gradient(1_p * 3_p)(2.0,0.0,5.0);
+	CHECK_CLOSE(result.value,10.0);
+	CHECK_CLOSE(result.grad[0],5.0);
+	BOOST_CHECK_EQUAL(result.grad[1],0.0);
+	CHECK_CLOSE(result.grad[2],2.0);
+}
+
+BOOST_AUTO_TEST_CASE( test_hess_reverse_sparse)
+{
+	//f = x0*x1 + x1*x2 + ... + x8*x9, whose Hessian is zero but for the
+	//entries next to the diagonal
+	unsigned int n = 10;
+	vector<Node*> nodes;
+	for(unsigned int i=0;i<n;i++)
+	{
+		nodes.push_back(create_var_node(i+1));
+	}
+	Node* root = create_binary_op_node(OP_TIMES,nodes[0],nodes[1]);
+	for(unsigned int i=1;i<n-1;i++)
+	{
+		root = create_binary_op_node(OP_PLUS,root,create_binary_op_node(OP_TIMES,nodes[i],nodes[i+1]));
+	}
+
+	EdgeSet s;
+	nonlinearEdges(root,s);
+	BOOST_CHECK_EQUAL(s.size(),n-1);
+	BOOST_CHECK_EQUAL(nzHess(s),2*(n-1));
+	Edge e(nodes[4],nodes[3]);
+	BOOST_CHECK(s.containsEdge(e));
+
+	//columns i and i+1 share no row, but columns i and i+2 share row i+1
+	vector<unsigned int> colors;
+	BOOST_CHECK_EQUAL(hess_coloring(s,nodes,colors),2);
+	for(unsigned int i=0;i+2<n;i++)
+	{
+		BOOST_CHECK(colors[i]!=colors[i+2]);
+	}
+
+	col_compress_matrix hess(n,n);
+	double val = hess_reverse_sparse(root,nodes,hess);
+	double eval = 0;
+	for(unsigned int i=0;i<n-1;i++)
+	{
+		eval += (i+1)*(i+2);
+	}
+	CHECK_CLOSE(val,eval);
+	BOOST_CHECK_EQUAL(hess.nnz(),2*(n-1));
+	const col_compress_matrix& chess = hess;
+	for(unsigned int i=0;i<n;i++)
+	{
+		for(unsigned int j=0;j<n;j++)
+		{
+			double h = (i+1==j || j+1==i) ? 1 : 0;
+			BOOST_CHECK_EQUAL(chess(i,j),h);
+		}
+	}
+}
+
+// Checks the value, gradient and, if hessian is true, Hessian computed by a
+// kernel from autodiff_kernels.hpp against those of the library.
+template <typename Kernel>
+void check_kernel(Kernel kernel, Node* root, vector<Node*>& list, bool hessian)
+{
+	unsigned int n = list.size();
+	vector<double> x, grad, kgrad(n), khess(n * n);
+	for(unsigned int i=0;i<n;i++){
+		x.push_back(boost::polymorphic_downcast<VNode*>(list[i])->val);
+	}
+	double val = grad_reverse(root,list,grad);
+	double kval = hessian ? kernel(&x[0],&kgrad[0],&khess[0]) : kernel(&x[0],&kgrad[0],NULL);
+	CHECK_CLOSE(kval,val);
+	for(unsigned int i=0;i<n;i++){
+		CHECK_CLOSE(kgrad[i],grad[i]);
+	}
+	if(!hessian){
+		return;
+	}
+	col_compress_matrix hess(n,n);
+	hess_reverse(root,list,hess);
+	const col_compress_matrix& chess = hess;
+	for(unsigned int j=0;j<n;j++){
+		for(unsigned int i=0;i<n;i++){
+			if(chess(i,j)==0){
+				BOOST_CHECK_SMALL(khess[j * n + i],1e-12);
+			}
+			else{
+				CHECK_CLOSE(khess[j * n + i],chess(i,j));
+			}
+		}
+	}
+}
+
+BOOST_AUTO_TEST_CASE( test_generated_kernels)
+{
+	using namespace autodiff_placeholders;
+	vector<Node*> list;
+	Node* root = build_linear_fun1(list);
+	check_kernel([](double const* x, double* grad, double*){ return linear_fun1_kernel(x,grad); },root,list,false);
+	list.clear();
+	root = build_nl_function1(list);
+	check_kernel(nl_function1_kernel,root,list,true);
+	list.clear();
+	root = to_auto_diff_node(sqrt_(1_p * 1_p * 1_p * 1_p) - cos_(-2_p) / 1_p,list,1.5,0.25);
+	check_kernel(unary_function_kernel,root,list,true);
+}
+
+BOOST_AUTO_TEST_CASE( test_grad_reverse_checkpointed)
+{
+	vector<Node*> list;
+	Node* root = build_nl_function1(list);
+	vector<double> grad, cgrad;
+	double val = grad_reverse(root,list,grad);
+	for(unsigned int segment : {0u, 1u, 5u, 100u}){
+		CHECK_CLOSE(grad_reverse_checkpointed(root,list,cgrad,segment),val);
+		for(unsigned int i=0;i<grad.size();i++){
+			CHECK_CLOSE(cgrad[i],grad[i]);
+		}
+	}
+
+	//a long iteration, y = sin(y) * x2 + x1, of which only y crosses each
+	//segment boundary
+	VNode* x1 = create_var_node(0.3);
+	VNode* x2 = create_var_node(0.9);
+	list.clear();
+	list.push_back(x1);
+	list.push_back(x2);
+	Node* y = x1;
+	for(unsigned int i=0;i<2000;i++){
+		y = create_binary_op_node(OP_PLUS,create_binary_op_node(OP_TIMES,create_uary_op_node(OP_SIN,y),x2),x1);
+	}
+	FlatTape tape;
+	flat_tape(y,list,tape);
+	double x[] = {0.3,0.9};
+	double tgrad[2], ckgrad[2];
+	val = tape.grad_reverse(x,tgrad);
+	unsigned int peak = 0;
+	CHECK_CLOSE(tape.grad_reverse_checkpointed(x,ckgrad,0,&peak),val);
+	CHECK_CLOSE(ckgrad[0],tgrad[0]);
+	CHECK_CLOSE(ckgrad[1],tgrad[1]);
+	//about 3 values per segment boundary, and 4 per entry of one segment
+	BOOST_CHECK(peak < 8 * sqrt(double(tape.size())));
+	BOOST_CHECK(peak < tape.size() / 10);
+}
+
+// Checks the values and Jacobian computed by jacobian() against those of
+// grad_reverse() on each output.
+template <typename ...Exprs, typename ...T>
+void check_jacobian(boost::hana::tuple<Exprs...> const& exprs, T ... args)
+{
+	vector<Node*> list;
+	vector<Node*> roots = to_auto_diff_nodes(exprs,list,args...);
+	unsigned int m = roots.size(), n = list.size();
+	col_compress_matrix jac(m,n);
+	vector<double> vals;
+	jacobian(exprs,vals,jac,args...);
+	BOOST_CHECK_EQUAL(vals.size(),m);
+	const col_compress_matrix& cjac = jac;
+	for(unsigned int i=0;i<m;i++)
+	{
+		vector<double> grad;
+		CHECK_CLOSE(vals[i],grad_reverse(roots[i],list,grad));
+		for(unsigned int j=0;j<n;j++)
+		{
+			//grad_reverse() leaves NaN for the variables a root does not use
+			if(grad[j]==0 || std::isnan(grad[j]))
+			{
+				BOOST_CHECK_EQUAL(cjac(i,j),0);
+			}
+			else
+			{
+				CHECK_CLOSE(cjac(i,j),grad[j]);
+			}
+		}
+	}
+}
+
+BOOST_AUTO_TEST_CASE( test_jacobian)
+{
+	using namespace autodiff_placeholders;
+	//more outputs than variables, so forward loops are used
+	auto residuals = boost::hana::make_tuple(
+		sin_(1_p * 2_p) + 3_p,
+		sin_(1_p * 2_p) * 1_p,
+		2_p / 3_p,
+		1_p * 1_p,
+		sqrt_(3_p)
+	);
+	check_jacobian(residuals,0.7,-1.3,2.5);
+
+	//more variables than outputs, so reverse loops are used
+	check_jacobian(
+		boost::hana::make_tuple(
+			(1_p * 2_p * sin_(1_p)) / 3_p + 2_p * 4_p - 1_p / 2_p,
+			cos_(4_p) - 1_p * 3_p),
+		-1.23,7.1231,2,-10);
+
+	//the outputs share one tape, on which sin(x1*x2) appears once
+	vector<Node*> list;
+	vector<Node*> roots = to_auto_diff_nodes(residuals,list,0.7,-1.3,2.5);
+	FlatTape tape;
+	vector<unsigned int> outputs;
+	flat_tape(roots,list,tape,outputs);
+	BOOST_CHECK_EQUAL(outputs.size(),5);
+	BOOST_CHECK_EQUAL(tape.size(),11);
+
+	//structural zeros are not stored
+	col_compress_matrix jac(5,3);
+	vector<double> vals;
+	jacobian(residuals,vals,jac,0.7,-1.3,2.5);
+	BOOST_CHECK_EQUAL(jac.nnz(),9);
+}
+
+// Checks the value, gradient and Hessian computed by hess_forward() against
+// those of grad_reverse() and hess_reverse().
+void check_hess_forward(Node* root, vector<Node*>& list)
+{
+	unsigned int n = list.size();
+	vector<double> grad, fgrad;
+	double val = grad_reverse(root,list,grad);
+	col_compress_matrix hess(n,n), fhess(n,n);
+	hess_reverse(root,list,hess);
+	CHECK_CLOSE(hess_forward(root,list,fgrad,fhess),val);
+	BOOST_CHECK_EQUAL(fgrad.size(),n);
+	const col_compress_matrix& chess = hess;
+	const col_compress_matrix& cfhess = fhess;
+	for(unsigned int i=0;i<n;i++)
+	{
+		CHECK_CLOSE(fgrad[i],grad[i]);
+		for(unsigned int j=0;j<n;j++)
+		{
+			if(chess(i,j)==0)
+			{
+				BOOST_CHECK_SMALL(double(cfhess(i,j)),1e-12);
+			}
+			else
+			{
+				CHECK_CLOSE(cfhess(i,j),chess(i,j));
+			}
+		}
+	}
+}
+
+BOOST_AUTO_TEST_CASE( test_hess_forward)
+{
+	using namespace autodiff_placeholders;
+	vector<Node*> list;
+	check_hess_forward(build_nl_function1(list),list);
+	list.clear();
+	check_hess_forward(to_auto_diff_node(sqrt_(1_p * 1_p * 1_p * 1_p) - cos_(-2_p) / 1_p,list,1.5,0.25),list);
+	list.clear();
+	check_hess_forward(to_auto_diff_node(sin_(1_p * 2_p) * sin_(1_p * 2_p),list,0.7,-1.3),list);
+	list.clear();
+	check_hess_forward(to_auto_diff_node(1_p * 1_p * 2_p,list,3,-2),list);
+
+	//f = x0*x1 + x1*x2 + ... + x8*x9; every term depends on two variables,
+	//and the root has just the n-1 nonzeros above the diagonal
+	unsigned int n = 10;
+	vector<Node*> nodes;
+	for(unsigned int i=0;i<n;i++)
+	{
+		nodes.push_back(create_var_node(i+1));
+	}
+	Node* root = create_binary_op_node(OP_TIMES,nodes[0],nodes[1]);
+	for(unsigned int i=1;i<n-1;i++)
+	{
+		root = create_binary_op_node(OP_PLUS,root,create_binary_op_node(OP_TIMES,nodes[i],nodes[i+1]));
+	}
+	check_hess_forward(root,nodes);
+	FlatTape tape;
+	flat_tape(root,nodes,tape);
+	vector<double> x;
+	for(unsigned int i=0;i<n;i++)
+	{
+		x.push_back(i+1);
+	}
+	SparseDerivs d;
+	tape.hess_forward(&x[0],d);
+	BOOST_CHECK_EQUAL(d.vars.size(),n);
+	BOOST_CHECK_EQUAL(d.hess.size(),n-1);
+	for(unsigned int k=0;k<d.hess.size();k++)
+	{
+		BOOST_CHECK_EQUAL(d.hess[k].row,k);
+		BOOST_CHECK_EQUAL(d.hess[k].col,k+1);
+		BOOST_CHECK_EQUAL(d.hess[k].val,1);
+	}
+}
+
+BOOST_AUTO_TEST_CASE( test_node_pool)
+{
+	reset_nodes();
+	NodePool& pool = node_pool();
+	BOOST_CHECK_EQUAL(pool.size(),0);
+
+	//nodes are placed one after another in creation order
+	vector<Node*> list;
+	Node* root = build_nl_function1(list);
+	BOOST_CHECK_EQUAL(pool.size(),12);
+	BOOST_CHECK_EQUAL(pool.nodes.back(),root);
+	for(unsigned int i=1;i<pool.size();i++)
+	{
+		BOOST_CHECK(pool.nodes[i-1] < pool.nodes[i]);
+	}
+	BOOST_CHECK_EQUAL(pool.numChunks(),1);
+	double val = eval_function(root);
+
+	//a large graph spans several chunks; reset keeps only the first
+	VNode* x = create_var_node(1);
+	Node* sum = x;
+	for(unsigned int i=0;i<10000;i++)
+	{
+		sum = create_binary_op_node(OP_PLUS,sum,x);
+	}
+	BOOST_CHECK(pool.numChunks()>1);
+	CHECK_CLOSE(eval_function(sum),10001);
+
+	reset_nodes();
+	BOOST_CHECK_EQUAL(pool.size(),0);
+	BOOST_CHECK_EQUAL(pool.numChunks(),1);
+
+	//the pool and the hash-consing tables are reused after a reset
+	list.clear();
+	root = build_nl_function1(list);
+	BOOST_CHECK_EQUAL(pool.size(),12);
+	CHECK_CLOSE(eval_function(root),val);
+}
+
+BOOST_AUTO_TEST_CASE( test_shared_subexpressions)
+{
+	VNode* x1 = create_var_node(0.7);
+	VNode* x2 = create_var_node(-1.3);
+	BOOST_CHECK_EQUAL(create_binary_op_node(OP_TIMES,x1,x2),create_binary_op_node(OP_TIMES,x1,x2));
+	BOOST_CHECK(create_binary_op_node(OP_TIMES,x1,x2)!=create_binary_op_node(OP_TIMES,x2,x1));
+	BOOST_CHECK_EQUAL(create_param_node(2.5),create_param_node(2.5));
+	BOOST_CHECK_EQUAL(create_uary_op_node(OP_SQRT,x1),create_uary_op_node(OP_SQRT,x1));
+
+	// Parameters are told apart by the bits of their values, so -0.0 keeps its
+	// sign, and NaN parameters share one node.
+	BOOST_CHECK(create_param_node(0.0)!=create_param_node(-0.0));
+	double inv = eval_function(create_binary_op_node(OP_DIVID,create_param_node(1),create_param_node(-0.0)));
+	BOOST_CHECK(std::isinf(inv) && inv<0);
+#ifdef NDEBUG
+	// PNode asserts that its value is not NaN.
+	PNode* nan = create_param_node(NaN_Double);
+	unsigned int nodes = node_pool().size();
+	BOOST_CHECK_EQUAL(create_param_node(NaN_Double),nan);
+	BOOST_CHECK_EQUAL(node_pool().size(),nodes);
+#endif
+
+	// sin(x1*x2) is built once, and is shared by both operands of the root.
+	using namespace autodiff_placeholders;
+	auto expr = sin_(1_p * 2_p) * sin_(1_p * 2_p);
+	vector<Node*> list;
+	Node* root = to_auto_diff_node(expr,list,0.7,-1.3);
+	Node* s = create_uary_op_node(OP_SIN,create_binary_op_node(OP_TIMES,list[0],list[1]));
+	BOOST_CHECK_EQUAL(root,create_binary_op_node(OP_TIMES,s,s));
+
+	check_gradient(expr,0.7,-1.3);
+
+	double x[] = {0.7,-1.3};
+	double u = x[0]*x[1];
+	double h[2][2] = {
+		{2*cos(2*u)*x[1]*x[1], 2*cos(2*u)*x[0]*x[1] + sin(2*u)},
+		{2*cos(2*u)*x[0]*x[1] + sin(2*u), 2*cos(2*u)*x[0]*x[0]}
+	};
+	for(unsigned int i=0;i<list.size();i++){
+		for(unsigned int j=0;j<list.size();j++){
+			static_cast<VNode*>(list[j])->u = i==j ? 1 : 0;
+		}
+		vector<double> dhess;
+		double val = hess_reverse(root,list,dhess);
+		CHECK_CLOSE(val,sin(u)*sin(u));
+		for(unsigned int j=0;j<dhess.size();j++){
+			CHECK_CLOSE(dhess[j],h[i][j]);
+		}
+	}
+	BOOST_CHECK_EQUAL(root->n_in_arcs,0);
+}
+
+// Evaluates nl_function1 and its gradient at a point that depends on i.
+vector<double> eval_nl_function1(int i)
+{
+	vector<Node*> list;
+	Node* root = build_nl_function1(list);
+	boost::polymorphic_downcast<VNode*>(list[0])->val += 0.01 * i;
+	boost::polymorphic_downcast<VNode*>(list[2])->val += 0.1 * i;
+	vector<double> grad;
+	double val = grad_reverse(root,list,grad);
+	grad.insert(grad.begin(),val);
+	return grad;
+}
+
+BOOST_AUTO_TEST_CASE( test_grad_reverse_threads)
+{
+	int const threads = 4;
+	int const evals_per_thread = 50;
+
+	vector<vector<vector<double> > > results(threads);
+	vector<std::thread> workers;
+	for(int t=0;t<threads;t++){
+		workers.emplace_back([t,&results] {
+			autodiff_setup();
+			for(int i=0;i<evals_per_thread;i++){
+				results[t].push_back(eval_nl_function1(t * evals_per_thread + i));
+			}
+			autodiff_cleanup();
+		});
+	}
+	for(auto & worker : workers){
+		worker.join();
+	}
+
+	// The main thread has its own tapes and stacks, from the fixture.
+	for(int t=0;t<threads;t++){
+		BOOST_CHECK_EQUAL(results[t].size(),evals_per_thread);
+		for(int i=0;i<evals_per_thread;i++){
+			vector<double> expected = eval_nl_function1(t * evals_per_thread + i);
+			for(unsigned int j=0;j<expected.size();j++){
+				CHECK_CLOSE(results[t][i][j],expected[j]);
+			}
+		}
+	}
+}
+
+BOOST_AUTO_TEST_CASE( test_grad_reverse_points)
+{
+	// The same points as eval_nl_function1(); 101 is not a multiple of the
+	// block size, so the last block is partly full.
+	unsigned int const npoints = 101;
+	vector<Node*> list;
+	Node* root = build_nl_function1(list);
+	unsigned int const n = list.size();
+	vector<double> x;
+	for(unsigned int i=0;i<npoints;i++){
+		for(unsigned int j=0;j<n;j++){
+			x.push_back(boost::polymorphic_downcast<VNode*>(list[j])->val);
+		}
+		x[i * n] += 0.01 * i;
+		x[i * n + 2] += 0.1 * i;
+	}
+
+	for(unsigned int nthreads : {1u, 3u, 0u}){
+		vector<double> f(npoints), grad(npoints * n);
+		grad_reverse_points(root,list,x.data(),npoints,f.data(),grad.data(),nthreads);
+		for(unsigned int i=0;i<npoints;i++){
+			vector<double> expected = eval_nl_function1(i);
+			CHECK_CLOSE(f[i],expected[0]);
+			for(unsigned int j=0;j<n;j++){
+				CHECK_CLOSE(grad[i * n + j],expected[j + 1]);
+			}
+		}
+	}
+
+	// Blocks of other sizes, straight from a tape.
+	FlatTape tape;
+	flat_tape(root,list,tape);
+	for(unsigned int block : {1u, 8u}){
+		vector<double> f(npoints), grad(npoints * n);
+		tape.grad_reverse_points(x.data(),npoints,f.data(),grad.data(),block);
+		for(unsigned int i=0;i<npoints;i+=10){
+			vector<double> expected = eval_nl_function1(i);
+			CHECK_CLOSE(f[i],expected[0]);
+			for(unsigned int j=0;j<n;j++){
+				CHECK_CLOSE(grad[i * n + j],expected[j + 1]);
+			}
+		}
+	}
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -12,6 +12,7 @@
 #include "Tape.h"
 #include "EdgeSet.h"
 #include "Node.h"
+#include "NodePool.h"
 #include "VNode.h"
 #include "OPNode.h"
 #include "ActNode.h"
@@ -19,24 +20,19 @@
 
 namespace AutoDiff {
 
-BinaryOPNode::BinaryOPNode(OPCODE op_, Node* left_, Node* right_):OPNode(op_,left_),right(right_)
+BinaryOPNode::BinaryOPNode(OPCODE op_, Node* left_, Node* right_):OPNode(op_,left_),right(right_),grad_r_dh(NaN_Double)
 {
 }
 
-OPNode* BinaryOPNode::createBinaryOpNode(OPCODE op, Node* left, Node* right)
+OPNode* BinaryOPNode::createBinaryOpNode(OPCODE op, Node* left, Node* right, NodePool& pool)
 {
 	assert(left!=NULL && right!=NULL);
 	OPNode* node = NULL;
-	node = new BinaryOPNode(op,left,right);
+	node = pool.adopt(new (pool.allocate(sizeof(BinaryOPNode))) BinaryOPNode(op,left,right));
 	return node;
 }
 
 BinaryOPNode::~BinaryOPNode() {
-	if(right->getType()!=VNode_Type)
-	{
-		delete right;
-		right = NULL;
-	}
 }
 
 void BinaryOPNode::inorder_visit(int level,ostream& oss){
@@ -102,9 +98,15 @@ void BinaryOPNode::calc_eval_function()
 //1. visiting left if not NULL
 //2. then, visiting right if not NULL
 //3. calculating the immediate derivative hu and hv
+//a shared node is only calculated on its first visit, which sets adj to 0
 void BinaryOPNode::grad_reverse_0()
 {
 	assert(left!=NULL && right != NULL);
+	if(!isnan(this->adj))
+	{
+		SV->push_back(val);
+		return;
+	}
 	this->adj = 0;
 	left->grad_reverse_0();
 	right->grad_reverse_0();
@@ -112,16 +114,22 @@ void BinaryOPNode::grad_reverse_0()
 }
 
 //right left - right most traversal
+//the adjoint is only propagated once it is complete, ie. when every incoming arc has been visited
 void BinaryOPNode::grad_reverse_1()
 {
 	assert(right!=NULL && left!=NULL);
-	double r_adj = SD->pop_back()*this->adj;
-	right->update_adj(r_adj);
-	double l_adj = SD->pop_back()*this->adj;
-	left->update_adj(l_adj);
-
-	right->grad_reverse_1();
-	left->grad_reverse_1();
+	n_in_arcs--;
+	if(n_in_arcs==0)
+	{
+		double r_adj = grad_r_dh*this->adj;
+		right->update_adj(r_adj);
+		double l_adj = grad_l_dh*this->adj;
+		left->update_adj(l_adj);
+		this->adj = NaN_Double;
+
+		right->grad_reverse_1();
+		left->grad_reverse_1();
+	}
 }
 
 void BinaryOPNode::calc_grad_reverse_0()
@@ -171,23 +179,31 @@ void BinaryOPNode::calc_grad_reverse_0()
 		cerr<<"error op not impl"<<endl;
 		break;
 	}
+	val = x;
+	grad_l_dh = l_dh;
+	grad_r_dh = r_dh;
 	SV->push_back(x);
-	SD->push_back(l_dh);
-	SD->push_back(r_dh);
 }
 
+//counts arcs rather than paths: the operands of a shared node are only visited on its first incoming arc
 void BinaryOPNode::hess_reverse_0_init_n_in_arcs()
 {
-	this->left->hess_reverse_0_init_n_in_arcs();
-	this->right->hess_reverse_0_init_n_in_arcs();
+	if(this->n_in_arcs==0)
+	{
+		this->left->hess_reverse_0_init_n_in_arcs();
+		this->right->hess_reverse_0_init_n_in_arcs();
+	}
 	this->Node::hess_reverse_0_init_n_in_arcs();
 }
 
 void BinaryOPNode::hess_reverse_1_clear_index()
 {
-	this->left->hess_reverse_1_clear_index();
-	this->right->hess_reverse_1_clear_index();
-	this->Node::hess_reverse_1_clear_index();
+	if(this->index!=Node::DEFAULT_INDEX)
+	{
+		this->left->hess_reverse_1_clear_index();
+		this->right->hess_reverse_1_clear_index();
+		this->Node::hess_reverse_1_clear_index();
+	}
 }
 
 unsigned int BinaryOPNode::hess_reverse_0()
@@ -396,32 +412,26 @@ void BinaryOPNode::hess_reverse_get_x(unsigned int i,double& x)
 
 void BinaryOPNode::nonlinearEdges(EdgeSet& edges)
 {
-	for(list<Edge>::iterator it=edges.edges.begin();it!=edges.edges.end();)
+	vector<Node*> others;
+	edges.removeEdgesOf(this,others);
+	for(vector<Node*>::iterator it=others.begin();it!=others.end();it++)
 	{
-		Edge e = *it;
-		if(e.a==this || e.b == this){
-			if(e.a == this && e.b == this)
-			{
-				Edge e1(left,left);
-				Edge e2(right,right);
-				Edge e3(left,right);
-				edges.insertEdge(e1);
-				edges.insertEdge(e2);
-				edges.insertEdge(e3);
-			}
-			else
-			{
-				Node* o = e.a==this? e.b: e.a;
-				Edge e1(left,o);
-				Edge e2(right,o);
-				edges.insertEdge(e1);
-				edges.insertEdge(e2);
-			}
-			it = edges.edges.erase(it);
+		Node* o = *it;
+		if(o == this)
+		{
+			Edge e1(left,left);
+			Edge e2(right,right);
+			Edge e3(left,right);
+			edges.insertEdge(e1);
+			edges.insertEdge(e2);
+			edges.insertEdge(e3);
 		}
 		else
 		{
-			it++;
+			Edge e1(left,o);
+			Edge e2(right,o);
+			edges.insertEdge(e1);
+			edges.insertEdge(e2);
 		}
 	}
 
@@ -13,11 +13,12 @@
 namespace AutoDiff {
 
 class EdgeSet;
+class NodePool;
 
 class BinaryOPNode: public OPNode {
 public:
 
-	static OPNode* createBinaryOpNode(OPCODE op, Node* left, Node* right);
+	static OPNode* createBinaryOpNode(OPCODE op, Node* left, Node* right, NodePool& pool);
 	virtual ~BinaryOPNode();
 
 	void collect_vnodes(boost::unordered_set<Node*>& nodes,unsigned int& total);
@@ -45,6 +46,8 @@ public:
 	string toString(int level);
 
 	Node* right;
+	//! dh/dv recorded by grad_reverse_0 for grad_reverse_1
+	double grad_r_dh;
 
 private:
 	BinaryOPNode(OPCODE op, Node* left, Node* right);
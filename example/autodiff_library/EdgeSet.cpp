@@ -7,66 +7,125 @@
 
 #include "EdgeSet.h"
 #include "Edge.h"
+#include <functional>
 #include <sstream>
 
 using namespace std;
 namespace AutoDiff {
 
-EdgeSet::EdgeSet() {
-	// TODO Auto-generated constructor stub
-
+EdgeSet::EdgeSet() : num_edges(0), num_self_edges(0) {
 }
 
 EdgeSet::~EdgeSet() {
-	edges.clear();
+	neighbours.clear();
 }
 
 bool EdgeSet::containsEdge(Edge& e)
 {
-	list<Edge>::iterator it = edges.begin();
-	for(;it!= edges.end();it++){
-		Edge eit = *it;
-		if(eit.isEqual(e))
+	Adjacency::iterator it = neighbours.find(e.a);
+	return it!=neighbours.end() && it->second.find(e.b)!=it->second.end();
+}
+
+void EdgeSet::insertEdge(Edge& e) {
+	if(neighbours[e.a].insert(e.b).second){
+		neighbours[e.b].insert(e.a);
+		num_edges++;
+		if(e.a == e.b)
 		{
-			return true;
+			num_self_edges++;
 		}
 	}
-	return false;
 }
 
-void EdgeSet::insertEdge(Edge& e) {
-	if(!containsEdge(e)){
-		edges.push_front(e);
+void EdgeSet::removeEdge(Edge& e) {
+	Adjacency::iterator it = neighbours.find(e.a);
+	if(it==neighbours.end() || it->second.erase(e.b)==0){
+		return;
+	}
+	if(it->second.empty())
+	{
+		neighbours.erase(it);
+	}
+	num_edges--;
+	if(e.a == e.b)
+	{
+		num_self_edges--;
+	}
+	else
+	{
+		Adjacency::iterator bit = neighbours.find(e.b);
+		bit->second.erase(e.a);
+		if(bit->second.empty())
+		{
+			neighbours.erase(bit);
+		}
+	}
+}
+
+void EdgeSet::removeEdgesOf(Node* n, vector<Node*>& others)
+{
+	Adjacency::iterator it = neighbours.find(n);
+	if(it==neighbours.end())
+	{
+		return;
+	}
+	boost::unordered_set<Node*> ns;
+	ns.swap(it->second);
+	neighbours.erase(it);
+	for(boost::unordered_set<Node*>::iterator o=ns.begin();o!=ns.end();o++)
+	{
+		others.push_back(*o);
+		num_edges--;
+		if(*o == n)
+		{
+			num_self_edges--;
+		}
+		else
+		{
+			Adjacency::iterator oit = neighbours.find(*o);
+			oit->second.erase(n);
+			if(oit->second.empty())
+			{
+				neighbours.erase(oit);
+			}
+		}
+	}
+}
+
+void EdgeSet::getEdges(vector<Edge>& edges)
+{
+	for(Adjacency::iterator it=neighbours.begin();it!=neighbours.end();it++)
+	{
+		for(boost::unordered_set<Node*>::iterator o=it->second.begin();o!=it->second.end();o++)
+		{
+			if(!std::less<Node*>()(*o,it->first))
+			{
+				edges.push_back(Edge(it->first,*o));
+			}
+		}
 	}
 }
 
 void EdgeSet::clear() {
-	edges.clear();
+	neighbours.clear();
+	num_edges = 0;
+	num_self_edges = 0;
 }
 
 unsigned int EdgeSet::size(){
-	return edges.size();
+	return num_edges;
 }
 
 unsigned int EdgeSet::numSelfEdges(){
-	unsigned int diag = 0;
-	list<Edge>::iterator it = edges.begin();
-	for(;it!=edges.end();it++)
-	{
-		Edge eit = *it;
-		if(eit.a == eit.b)
-		{
-			diag++;
-		}
-	}
-	return diag;
+	return num_self_edges;
 }
 
 string EdgeSet::toString()
 {
 	ostringstream oss;
-	list<Edge>::iterator it = edges.begin();
-	for(;it!=edges.end();it++)
+	vector<Edge> edges;
+	getEdges(edges);
+	for(vector<Edge>::iterator it=edges.begin();it!=edges.end();it++)
 	{
 		oss<<(*it).toString()<<endl;
 	}
@@ -9,10 +9,15 @@
 #define EDGESET_H_
 
 #include "Edge.h"
-#include <list>
+#include <vector>
+#include <boost/unordered_map.hpp>
+#include <boost/unordered_set.hpp>
 
 namespace AutoDiff {
 
+//an undirected graph, stored as the set of neighbours of each node, so that
+//inserting, finding and removing an edge take constant time, and finding
+//the edges of a node takes time proportional to their number
 class EdgeSet {
 public:
 	EdgeSet();
@@ -20,13 +25,24 @@ public:
 
 	void insertEdge(Edge& e);
 	bool containsEdge(Edge& e);
+	void removeEdge(Edge& e);
+	//removes every edge of n, and appends the other end of each to others;
+	//the other end of a self edge is n itself
+	void removeEdgesOf(Node* n, std::vector<Node*>& others);
+	//appends each edge once to edges
+	void getEdges(std::vector<Edge>& edges);
 	unsigned int numSelfEdges();
 	void clear();
 	unsigned int size();
 	std::string toString();
 
+	typedef boost::unordered_map<Node*,boost::unordered_set<Node*> > Adjacency;
+	//the neighbours of each node; a node with a self edge is its own neighbour
+	Adjacency neighbours;
 
-	std::list<Edge> edges;
+private:
+	unsigned int num_edges;
+	unsigned int num_self_edges;
 };
 
 } /* namespace AutoDiff */
@@ -0,0 +1,1021 @@
+/*
+ * FlatTape.cpp
+ */
+
+#include <cassert>
+#include <cmath>
+#include <algorithm>
+#include <sstream>
+
+#include "FlatTape.h"
+
+namespace AutoDiff {
+
+const unsigned int FlatTape::NONE;
+const unsigned int FlatTape::HESS_BLOCK;
+const unsigned int FlatTape::POINT_BLOCK;
+
+FlatTape::FlatTape() : num_vars(0)
+{
+}
+
+unsigned int FlatTape::add_var(unsigned int var_index)
+{
+	code.push_back(TAPE_VAR);
+	left.push_back(var_index);
+	right.push_back(NONE);
+	val.push_back(NaN_Double);
+	num_vars = std::max(num_vars, var_index + 1);
+	return code.size() - 1;
+}
+
+unsigned int FlatTape::add_param(double value)
+{
+	code.push_back(TAPE_PARAM);
+	left.push_back(NONE);
+	right.push_back(NONE);
+	val.push_back(value);
+	return code.size() - 1;
+}
+
+unsigned int FlatTape::add_op(OPCODE op, unsigned int l, unsigned int r)
+{
+	assert(l < code.size());
+	assert(r == NONE || r < code.size());
+	code.push_back(op);
+	left.push_back(l);
+	right.push_back(r);
+	val.push_back(NaN_Double);
+	return code.size() - 1;
+}
+
+unsigned int FlatTape::size() const
+{
+	return code.size();
+}
+
+unsigned int FlatTape::nvars() const
+{
+	return num_vars;
+}
+
+void FlatTape::set_nvars(unsigned int n)
+{
+	num_vars = std::max(num_vars, n);
+}
+
+void FlatTape::clear()
+{
+	code.clear();
+	left.clear();
+	right.clear();
+	val.clear();
+	left_partial.clear();
+	right_partial.clear();
+	adj.clear();
+	left_left_partial.clear();
+	left_right_partial.clear();
+	right_right_partial.clear();
+	tangent.clear();
+	tangent_adj.clear();
+	output_adj.clear();
+	derivs.clear();
+	num_vars = 0;
+}
+
+//evaluates every entry in order; the first (Order > 0) and second (Order > 1)
+//partial derivatives of each operation with respect to its operands are
+//recorded too
+template<int Order> void FlatTape::forward(const double* x)
+{
+	const unsigned int n = code.size();
+	if(Order > 0){
+		left_partial.resize(n);
+		right_partial.resize(n);
+	}
+	if(Order > 1){
+		left_left_partial.resize(n);
+		left_right_partial.resize(n);
+		right_right_partial.resize(n);
+	}
+	for(unsigned int i=0;i<n;i++)
+	{
+		double lx = 0, rx = 0, dl = 0, dr = 0, dll = 0, dlr = 0, drr = 0;
+		const int c = code[i];
+		if(c < TAPE_VAR){
+			lx = val[left[i]];
+			if(right[i] != NONE) rx = val[right[i]];
+		}
+		switch(c)
+		{
+		case TAPE_VAR:
+			val[i] = x[left[i]];
+			break;
+		case TAPE_PARAM:
+			break;
+		case OP_PLUS:
+			val[i] = lx + rx;
+			dl = 1;
+			dr = 1;
+			break;
+		case OP_MINUS:
+			val[i] = lx - rx;
+			dl = 1;
+			dr = -1;
+			break;
+		case OP_TIMES:
+			val[i] = lx * rx;
+			dl = rx;
+			dr = lx;
+			dlr = 1;
+			break;
+		case OP_DIVID:
+			val[i] = lx / rx;
+			dl = 1 / rx;
+			dr = -lx / (rx * rx);
+			if(Order > 1){
+				dlr = -1 / (rx * rx);
+				drr = 2 * lx / (rx * rx * rx);
+			}
+			break;
+		case OP_POW:
+			val[i] = pow(lx,rx);
+			dl = rx * pow(lx,rx-1);
+			//d(0^x2)/d(x2) = 0; log(lx) is not defined otherwise
+			dr = lx > 0 ? val[i] * log(lx) : 0;
+			if(Order > 1){
+				dll = rx * (rx-1) * pow(lx,rx-2);
+				if(lx > 0){
+					dlr = pow(lx,rx-1) * (rx * log(lx) + 1);
+					drr = val[i] * log(lx) * log(lx);
+				}
+			}
+			break;
+		case OP_SIN:
+			val[i] = sin(lx);
+			dl = cos(lx);
+			dll = -val[i];
+			break;
+		case OP_COS:
+			val[i] = cos(lx);
+			dl = -sin(lx);
+			dll = -val[i];
+			break;
+		case OP_SQRT:
+			val[i] = sqrt(lx);
+			dl = 0.5 / val[i];
+			dll = -0.25 / (lx * val[i]);
+			break;
+		case OP_NEG:
+			val[i] = -lx;
+			dl = -1;
+			break;
+		default:
+			assert(false);
+			break;
+		}
+		if(Order > 0){
+			left_partial[i] = dl;
+			right_partial[i] = dr;
+		}
+		if(Order > 1){
+			left_left_partial[i] = dll;
+			left_right_partial[i] = dlr;
+			right_right_partial[i] = drr;
+		}
+	}
+}
+
+//propagates the adjoint of the root to every entry, using the partials
+//recorded by forward()
+void FlatTape::reverse()
+{
+	adj.assign(code.size(), 0.0);
+	adj.back() = 1;
+	for(unsigned int i=code.size();i-- > 0;)
+	{
+		const double a = adj[i];
+		if(code[i] < TAPE_VAR){
+			adj[left[i]] += left_partial[i] * a;
+			if(right[i] != NONE) adj[right[i]] += right_partial[i] * a;
+		}
+	}
+}
+
+double FlatTape::eval_function(const double* x)
+{
+	assert(!code.empty());
+	forward<0>(x);
+	return val.back();
+}
+
+double FlatTape::grad_reverse(const double* x, double* grad)
+{
+	assert(!code.empty());
+	forward<1>(x);
+	reverse();
+	std::fill(grad, grad + num_vars, 0.0);
+	for(unsigned int i=0;i<code.size();i++)
+	{
+		if(code[i] == TAPE_VAR) grad[left[i]] += adj[i];
+	}
+	return val.back();
+}
+
+double FlatTape::hess_reverse(const double* x, double* hess, unsigned int block)
+{
+	assert(!code.empty());
+	assert(block > 0);
+	forward<2>(x);
+	reverse();
+	std::fill(hess, hess + num_vars * num_vars, 0.0);
+	vector<double> dirs;
+	for(unsigned int first=0;first<num_vars;first+=block)
+	{
+		const unsigned int k = std::min(block, num_vars - first);
+		dirs.assign(num_vars * k, 0.0);
+		for(unsigned int l=0;l<k;l++) dirs[l * num_vars + first + l] = 1;
+		hess_block(&dirs[0], k, block, hess + first * num_vars);
+	}
+	return val.back();
+}
+
+double FlatTape::hess_vec_reverse(const double* x, const double* dirs, unsigned int k, double* hv, unsigned int block)
+{
+	assert(!code.empty());
+	assert(block > 0);
+	forward<2>(x);
+	reverse();
+	std::fill(hv, hv + num_vars * k, 0.0);
+	for(unsigned int first=0;first<k;first+=block)
+	{
+		hess_block(dirs + first * num_vars, std::min(block, k - first), block, hv + first * num_vars);
+	}
+	return val.back();
+}
+
+//adds the Hessian times each of the k <= block directions in dirs to out,
+//using the partials and adjoints recorded by forward<2>() and reverse()
+void FlatTape::hess_block(const double* dirs, unsigned int k, unsigned int block, double* out)
+{
+	const unsigned int n = code.size();
+	tangent.resize(n * block);
+	tangent_adj.resize(n * block);
+
+	//the tangents of the directions; lanes past k are zero
+	for(unsigned int i=0;i<n;i++)
+	{
+		double* w = &tangent[i * block];
+		const int c = code[i];
+		if(c == TAPE_VAR){
+			for(unsigned int l=0;l<block;l++) w[l] = l < k ? dirs[l * num_vars + left[i]] : 0;
+		}
+		else if(c == TAPE_PARAM){
+			for(unsigned int l=0;l<block;l++) w[l] = 0;
+		}
+		else if(right[i] == NONE){
+			const double* wl = &tangent[left[i] * block];
+			const double dl = left_partial[i];
+			for(unsigned int l=0;l<block;l++) w[l] = dl * wl[l];
+		}
+		else{
+			const double* wl = &tangent[left[i] * block];
+			const double* wr = &tangent[right[i] * block];
+			const double dl = left_partial[i], dr = right_partial[i];
+			for(unsigned int l=0;l<block;l++) w[l] = dl * wl[l] + dr * wr[l];
+		}
+	}
+
+	//the second order adjoints, ie. the Hessian times each direction
+	std::fill(tangent_adj.begin(), tangent_adj.end(), 0.0);
+	for(unsigned int i=n;i-- > 0;)
+	{
+		const double* wb = &tangent_adj[i * block];
+		const int c = code[i];
+		if(c == TAPE_VAR){
+			for(unsigned int l=0;l<k;l++) out[l * num_vars + left[i]] += wb[l];
+		}
+		else if(c == TAPE_PARAM){
+			//parameters have no operands
+		}
+		else if(right[i] == NONE){
+			double* wbl = &tangent_adj[left[i] * block];
+			const double* wl = &tangent[left[i] * block];
+			const double dl = left_partial[i];
+			const double all = adj[i] * left_left_partial[i];
+			for(unsigned int l=0;l<block;l++) wbl[l] += dl * wb[l] + all * wl[l];
+		}
+		else{
+			double* wbl = &tangent_adj[left[i] * block];
+			double* wbr = &tangent_adj[right[i] * block];
+			const double* wl = &tangent[left[i] * block];
+			const double* wr = &tangent[right[i] * block];
+			const double dl = left_partial[i], dr = right_partial[i];
+			const double all = adj[i] * left_left_partial[i];
+			const double alr = adj[i] * left_right_partial[i];
+			const double arr = adj[i] * right_right_partial[i];
+			for(unsigned int l=0;l<block;l++){
+				const double wll = wl[l], wrl = wr[l], wbi = wb[l];
+				wbl[l] += dl * wbi + all * wll + alr * wrl;
+				wbr[l] += dr * wbi + alr * wll + arr * wrl;
+			}
+		}
+	}
+}
+
+
+//the C++ expressions for the value of entry i of a tape and its partials,
+//in terms of the locals of its operands; an empty partial is zero
+struct EntryExprs {
+	string v, dl, dr, dll, dlr, drr;
+};
+
+static string local(char prefix, unsigned int i)
+{
+	ostringstream oss;
+	oss << prefix << i;
+	return oss.str();
+}
+
+static EntryExprs entry_exprs(const FlatTape& t, unsigned int i)
+{
+	EntryExprs e;
+	const string l = t.code[i] < TAPE_VAR ? local('v', t.left[i]) : "";
+	const string r = t.code[i] < TAPE_VAR && t.right[i] != FlatTape::NONE ? local('v', t.right[i]) : "";
+	const string v = local('v', i);
+	ostringstream oss;
+	switch(t.code[i])
+	{
+	case TAPE_VAR:
+		oss << "x[" << t.left[i] << "]";
+		e.v = oss.str();
+		break;
+	case TAPE_PARAM:
+		oss.precision(17);
+		oss << t.val[i];
+		e.v = oss.str();
+		break;
+	case OP_PLUS:
+		e.v = l + " + " + r;
+		e.dl = "1.0";
+		e.dr = "1.0";
+		break;
+	case OP_MINUS:
+		e.v = l + " - " + r;
+		e.dl = "1.0";
+		e.dr = "-1.0";
+		break;
+	case OP_TIMES:
+		e.v = l + " * " + r;
+		e.dl = r;
+		e.dr = l;
+		e.dlr = "1.0";
+		break;
+	case OP_DIVID:
+		e.v = l + " / " + r;
+		e.dl = "1.0 / " + r;
+		e.dr = "-" + l + " / (" + r + " * " + r + ")";
+		e.dlr = "-1.0 / (" + r + " * " + r + ")";
+		e.drr = "2.0 * " + l + " / (" + r + " * " + r + " * " + r + ")";
+		break;
+	case OP_POW:
+		e.v = "std::pow(" + l + ", " + r + ")";
+		e.dl = r + " * std::pow(" + l + ", " + r + " - 1.0)";
+		e.dr = "(" + l + " > 0.0 ? " + v + " * std::log(" + l + ") : 0.0)";
+		e.dll = r + " * (" + r + " - 1.0) * std::pow(" + l + ", " + r + " - 2.0)";
+		e.dlr = "(" + l + " > 0.0 ? std::pow(" + l + ", " + r + " - 1.0) * (" + r + " * std::log(" + l + ") + 1.0) : 0.0)";
+		e.drr = "(" + l + " > 0.0 ? " + v + " * std::log(" + l + ") * std::log(" + l + ") : 0.0)";
+		break;
+	case OP_SIN:
+		e.v = "std::sin(" + l + ")";
+		e.dl = "std::cos(" + l + ")";
+		e.dll = "-" + v;
+		break;
+	case OP_COS:
+		e.v = "std::cos(" + l + ")";
+		e.dl = "-std::sin(" + l + ")";
+		e.dll = "-" + v;
+		break;
+	case OP_SQRT:
+		e.v = "std::sqrt(" + l + ")";
+		e.dl = "0.5 / " + v;
+		e.dll = "-0.25 / (" + l + " * " + v + ")";
+		break;
+	case OP_NEG:
+		e.v = "-" + l;
+		e.dl = "-1.0";
+		break;
+	default:
+		assert(false);
+		break;
+	}
+	return e;
+}
+
+//the forward loop defines v<i> and the partials d<i>l, d<i>r, d<i>ll, d<i>lr
+//and d<i>rr of every entry, and the reverse loop accumulates the adjoints
+//a<i>; the Hessian is computed one column at a time, from the tangents t<i>
+//and second order adjoints b<i> of each unit direction
+void FlatTape::emit_cpp(ostream& os, const string& name, bool hessian) const
+{
+	assert(!code.empty());
+	const unsigned int n = code.size();
+	vector<EntryExprs> exprs;
+	for(unsigned int i=0;i<n;i++) exprs.push_back(entry_exprs(*this, i));
+	const string pre = "    ";
+
+	os << "inline double " << name << "(double const * x, double * grad" << (hessian ? ", double * hess" : "") << ")\n";
+	os << "{\n";
+	for(unsigned int i=0;i<n;i++)
+	{
+		const EntryExprs& e = exprs[i];
+		os << pre << "double const v" << i << " = " << e.v << ";\n";
+		if(!e.dl.empty()) os << pre << "double const d" << i << "l = " << e.dl << ";\n";
+		if(!e.dr.empty()) os << pre << "double const d" << i << "r = " << e.dr << ";\n";
+		if(hessian){
+			if(!e.dll.empty()) os << pre << "double const d" << i << "ll = " << e.dll << ";\n";
+			if(!e.dlr.empty()) os << pre << "double const d" << i << "lr = " << e.dlr << ";\n";
+			if(!e.drr.empty()) os << pre << "double const d" << i << "rr = " << e.drr << ";\n";
+		}
+	}
+
+	//adjoints
+	os << "\n";
+	for(unsigned int i=0;i<n;i++)
+	{
+		os << pre << "double a" << i << " = " << (i == n - 1 ? "1.0" : "0.0") << ";\n";
+	}
+	for(unsigned int i=n;i-- > 0;)
+	{
+		if(code[i] < TAPE_VAR){
+			os << pre << "a" << left[i] << " += d" << i << "l * a" << i << ";\n";
+			if(right[i] != NONE) os << pre << "a" << right[i] << " += d" << i << "r * a" << i << ";\n";
+		}
+	}
+	for(unsigned int k=0;k<num_vars;k++) os << pre << "grad[" << k << "] = 0.0;\n";
+	for(unsigned int i=0;i<n;i++)
+	{
+		if(code[i] == TAPE_VAR) os << pre << "grad[" << left[i] << "] += a" << i << ";\n";
+	}
+
+	if(hessian){
+		os << "\n";
+		os << pre << "for (unsigned int k = 0; k < " << num_vars << "; ++k) {\n";
+		const string pre2 = pre + pre;
+		//only the tangents that second partials are multiplied by, and those
+		//they are computed from, are needed
+		vector<bool> needed(n, false);
+		for(unsigned int i=n;i-- > 0;)
+		{
+			if(code[i] >= TAPE_VAR) continue;
+			const EntryExprs& e = exprs[i];
+			if(needed[i] || !e.dll.empty() || !e.dlr.empty()) needed[left[i]] = true;
+			if(right[i] != NONE && (needed[i] || !e.dlr.empty() || !e.drr.empty())) needed[right[i]] = true;
+		}
+		for(unsigned int i=0;i<n;i++)
+		{
+			if(!needed[i]) continue;
+			os << pre2 << "double const t" << i << " = ";
+			if(code[i] == TAPE_VAR) os << "k == " << left[i] << " ? 1.0 : 0.0";
+			else if(code[i] == TAPE_PARAM) os << "0.0";
+			else if(right[i] == NONE) os << "d" << i << "l * t" << left[i];
+			else os << "d" << i << "l * t" << left[i] << " + d" << i << "r * t" << right[i];
+			os << ";\n";
+		}
+		for(unsigned int i=0;i<n;i++) os << pre2 << "double b" << i << " = 0.0;\n";
+		for(unsigned int i=n;i-- > 0;)
+		{
+			if(code[i] >= TAPE_VAR) continue;
+			const EntryExprs& e = exprs[i];
+			const string tl = local('t', left[i]);
+			os << pre2 << "b" << left[i] << " += d" << i << "l * b" << i;
+			if(!e.dll.empty()) os << " + a" << i << " * d" << i << "ll * " << tl;
+			if(right[i] != NONE){
+				const string tr = local('t', right[i]);
+				if(!e.dlr.empty()) os << " + a" << i << " * d" << i << "lr * " << tr;
+				os << ";\n";
+				os << pre2 << "b" << right[i] << " += d" << i << "r * b" << i;
+				if(!e.dlr.empty()) os << " + a" << i << " * d" << i << "lr * " << tl;
+				if(!e.drr.empty()) os << " + a" << i << " * d" << i << "rr * " << tr;
+			}
+			os << ";\n";
+		}
+		for(unsigned int j=0;j<num_vars;j++) os << pre2 << "hess[k * " << num_vars << " + " << j << "] = 0.0;\n";
+		for(unsigned int i=0;i<n;i++)
+		{
+			if(code[i] == TAPE_VAR) os << pre2 << "hess[k * " << num_vars << " + " << left[i] << "] += b" << i << ";\n";
+		}
+		os << pre << "}\n";
+	}
+
+	os << "\n";
+	os << pre << "return v" << n - 1 << ";\n";
+	os << "}\n";
+}
+
+//the value of an operation, and its partials with respect to its operands
+static double eval_op(int c, double lx, double rx, double& dl, double& dr)
+{
+	double v = 0;
+	dl = 0;
+	dr = 0;
+	switch(c)
+	{
+	case OP_PLUS:
+		v = lx + rx;
+		dl = 1;
+		dr = 1;
+		break;
+	case OP_MINUS:
+		v = lx - rx;
+		dl = 1;
+		dr = -1;
+		break;
+	case OP_TIMES:
+		v = lx * rx;
+		dl = rx;
+		dr = lx;
+		break;
+	case OP_DIVID:
+		v = lx / rx;
+		dl = 1 / rx;
+		dr = -lx / (rx * rx);
+		break;
+	case OP_POW:
+		v = pow(lx,rx);
+		dl = rx * pow(lx,rx-1);
+		dr = lx > 0 ? v * log(lx) : 0;
+		break;
+	case OP_SIN:
+		v = sin(lx);
+		dl = cos(lx);
+		break;
+	case OP_COS:
+		v = cos(lx);
+		dl = -sin(lx);
+		break;
+	case OP_SQRT:
+		v = sqrt(lx);
+		dl = 0.5 / v;
+		break;
+	case OP_NEG:
+		v = -lx;
+		dl = -1;
+		break;
+	default:
+		assert(false);
+		break;
+	}
+	return v;
+}
+
+//evaluates entries start..end-1 and their partials into v, dl and dr, which
+//are indexed from start; live holds the values of earlier entries they use
+void FlatTape::eval_segment(const double* x, unsigned int start, unsigned int end,
+		const boost::unordered_map<unsigned int,double>& live, double* v, double* dl, double* dr) const
+{
+	for(unsigned int i=start;i<end;i++)
+	{
+		const int c = code[i];
+		const unsigned int k = i - start;
+		if(c == TAPE_VAR){
+			v[k] = x[left[i]];
+		}
+		else if(c == TAPE_PARAM){
+			v[k] = val[i];
+		}
+		else{
+			const unsigned int l = left[i], r = right[i];
+			const double lx = l >= start ? v[l - start] : live.find(l)->second;
+			const double rx = r == NONE ? 0 : r >= start ? v[r - start] : live.find(r)->second;
+			v[k] = eval_op(c, lx, rx, dl[k], dr[k]);
+		}
+	}
+}
+
+double FlatTape::grad_reverse_checkpointed(const double* x, double* grad, unsigned int segment,
+		unsigned int* peak) const
+{
+	assert(!code.empty());
+	const unsigned int n = code.size();
+	if(segment == 0) segment = std::max(1u, (unsigned int)ceil(sqrt(double(n))));
+	const unsigned int nsegs = (n + segment - 1) / segment;
+
+	//the last entry using each entry; the root is used by the end of the tape
+	vector<unsigned int> last_use(n, 0);
+	for(unsigned int i=0;i<n;i++)
+	{
+		if(code[i] < TAPE_VAR){
+			last_use[left[i]] = i;
+			if(right[i] != NONE) last_use[right[i]] = i;
+		}
+	}
+	last_use[n-1] = n;
+
+	//the values of the segment being evaluated, and their partials
+	vector<double> v(segment), dl(segment), dr(segment), a(segment);
+	//the values of entries before the segment that it or later ones use
+	boost::unordered_map<unsigned int,double> live;
+	//the values live at the start of each segment
+	vector<vector<pair<unsigned int,double> > > saved(nsegs);
+	unsigned int num_saved = 0, max_held = 0;
+
+	for(unsigned int s=0;s<nsegs;s++)
+	{
+		const unsigned int start = s * segment, end = std::min(n, start + segment);
+		saved[s].assign(live.begin(), live.end());
+		num_saved += saved[s].size();
+		eval_segment(x, start, end, live, &v[0], &dl[0], &dr[0]);
+		for(boost::unordered_map<unsigned int,double>::iterator it=live.begin();it!=live.end();)
+		{
+			if(last_use[it->first] < end) it = live.erase(it);
+			else ++it;
+		}
+		for(unsigned int i=start;i<end;i++)
+		{
+			if(last_use[i] >= end) live[i] = v[i - start];
+		}
+		max_held = std::max(max_held, num_saved + (unsigned int)live.size() + 3 * segment);
+	}
+	const double root = v[(n - 1) - (nsegs - 1) * segment];
+
+	//adjoints of entries before the segment being differentiated
+	boost::unordered_map<unsigned int,double> adjs;
+	std::fill(grad, grad + num_vars, 0.0);
+	for(unsigned int s=nsegs;s-- > 0;)
+	{
+		const unsigned int start = s * segment, end = std::min(n, start + segment);
+		live.clear();
+		live.insert(saved[s].begin(), saved[s].end());
+		eval_segment(x, start, end, live, &v[0], &dl[0], &dr[0]);
+		std::fill(a.begin(), a.end(), 0.0);
+		if(end == n) a[end - 1 - start] = 1;
+		for(unsigned int i=start;i<end;i++)
+		{
+			boost::unordered_map<unsigned int,double>::iterator it = adjs.find(i);
+			if(it != adjs.end()){
+				a[i - start] += it->second;
+				adjs.erase(it);
+			}
+		}
+		max_held = std::max(max_held, num_saved + (unsigned int)(live.size() + adjs.size()) + 4 * segment);
+		for(unsigned int i=end;i-- > start;)
+		{
+			const double ai = a[i - start];
+			const int c = code[i];
+			if(c == TAPE_VAR){
+				grad[left[i]] += ai;
+			}
+			else if(c != TAPE_PARAM){
+				const unsigned int l = left[i], r = right[i];
+				if(l >= start) a[l - start] += dl[i - start] * ai;
+				else adjs[l] += dl[i - start] * ai;
+				if(r != NONE){
+					if(r >= start) a[r - start] += dr[i - start] * ai;
+					else adjs[r] += dr[i - start] * ai;
+				}
+			}
+		}
+		num_saved -= saved[s].size();
+		vector<pair<unsigned int,double> >().swap(saved[s]);
+	}
+	if(peak) *peak = max_held;
+	return root;
+}
+
+void FlatTape::grad_reverse_points(const double* x, unsigned int npoints, double* f, double* grad,
+		unsigned int block) const
+{
+	assert(!code.empty());
+	assert(block > 0);
+	const unsigned int n = code.size();
+	//block lanes per entry
+	vector<double> v(n * block), dl(n * block), dr(n * block), a(n * block);
+	std::fill(grad, grad + npoints * num_vars, 0.0);
+	for(unsigned int first=0;first<npoints;first+=block)
+	{
+		//lanes past the last point repeat it, so that they stay finite
+		const unsigned int k = std::min(block, npoints - first);
+		for(unsigned int i=0;i<n;i++)
+		{
+			double* vi = &v[i * block];
+			double* dli = &dl[i * block];
+			double* dri = &dr[i * block];
+			const int c = code[i];
+			const double* lv = c < TAPE_VAR ? &v[left[i] * block] : NULL;
+			const double* rv = c < TAPE_VAR && right[i] != NONE ? &v[right[i] * block] : NULL;
+			switch(c)
+			{
+			case TAPE_VAR:
+				for(unsigned int l=0;l<block;l++) vi[l] = x[(first + std::min(l,k-1)) * num_vars + left[i]];
+				break;
+			case TAPE_PARAM:
+				for(unsigned int l=0;l<block;l++) vi[l] = val[i];
+				break;
+			case OP_PLUS:
+				for(unsigned int l=0;l<block;l++){
+					vi[l] = lv[l] + rv[l];
+					dli[l] = 1;
+					dri[l] = 1;
+				}
+				break;
+			case OP_MINUS:
+				for(unsigned int l=0;l<block;l++){
+					vi[l] = lv[l] - rv[l];
+					dli[l] = 1;
+					dri[l] = -1;
+				}
+				break;
+			case OP_TIMES:
+				for(unsigned int l=0;l<block;l++){
+					vi[l] = lv[l] * rv[l];
+					dli[l] = rv[l];
+					dri[l] = lv[l];
+				}
+				break;
+			case OP_DIVID:
+				for(unsigned int l=0;l<block;l++){
+					vi[l] = lv[l] / rv[l];
+					dli[l] = 1 / rv[l];
+					dri[l] = -lv[l] / (rv[l] * rv[l]);
+				}
+				break;
+			case OP_POW:
+				for(unsigned int l=0;l<block;l++){
+					vi[l] = pow(lv[l],rv[l]);
+					dli[l] = rv[l] * pow(lv[l],rv[l]-1);
+					dri[l] = lv[l] > 0 ? vi[l] * log(lv[l]) : 0;
+				}
+				break;
+			case OP_SIN:
+				for(unsigned int l=0;l<block;l++){
+					vi[l] = sin(lv[l]);
+					dli[l] = cos(lv[l]);
+				}
+				break;
+			case OP_COS:
+				for(unsigned int l=0;l<block;l++){
+					vi[l] = cos(lv[l]);
+					dli[l] = -sin(lv[l]);
+				}
+				break;
+			case OP_SQRT:
+				for(unsigned int l=0;l<block;l++){
+					vi[l] = sqrt(lv[l]);
+					dli[l] = 0.5 / vi[l];
+				}
+				break;
+			case OP_NEG:
+				for(unsigned int l=0;l<block;l++){
+					vi[l] = -lv[l];
+					dli[l] = -1;
+				}
+				break;
+			default:
+				assert(false);
+				break;
+			}
+		}
+
+		std::fill(a.begin(), a.end(), 0.0);
+		std::fill(a.end() - block, a.end(), 1.0);
+		for(unsigned int i=n;i-- > 0;)
+		{
+			const double* ai = &a[i * block];
+			const int c = code[i];
+			if(c == TAPE_VAR){
+				for(unsigned int l=0;l<k;l++) grad[(first + l) * num_vars + left[i]] += ai[l];
+			}
+			else if(c != TAPE_PARAM){
+				double* al = &a[left[i] * block];
+				const double* dli = &dl[i * block];
+				for(unsigned int l=0;l<block;l++) al[l] += dli[l] * ai[l];
+				if(right[i] != NONE){
+					double* ar = &a[right[i] * block];
+					const double* dri = &dr[i * block];
+					for(unsigned int l=0;l<block;l++) ar[l] += dri[l] * ai[l];
+				}
+			}
+		}
+		for(unsigned int l=0;l<k;l++) f[first + l] = v[(n - 1) * block + l];
+	}
+}
+
+
+void FlatTape::jacobian(const double* x, const unsigned int* outputs, unsigned int m, double* f, JacobianSink& jac,
+		unsigned int block)
+{
+	assert(!code.empty());
+	assert(block > 0);
+	forward<1>(x);
+	const unsigned int n = code.size();
+	for(unsigned int o=0;o<m;o++) f[o] = val[outputs[o]];
+
+	if(num_vars <= m){
+		//columns first..first+k-1, from the tangents of unit directions
+		tangent.resize(n * block);
+		for(unsigned int first=0;first<num_vars;first+=block)
+		{
+			const unsigned int k = std::min(block, num_vars - first);
+			for(unsigned int i=0;i<n;i++)
+			{
+				double* w = &tangent[i * block];
+				const int c = code[i];
+				if(c == TAPE_VAR){
+					for(unsigned int l=0;l<block;l++) w[l] = left[i] == first + l && l < k ? 1 : 0;
+				}
+				else if(c == TAPE_PARAM){
+					for(unsigned int l=0;l<block;l++) w[l] = 0;
+				}
+				else if(right[i] == NONE){
+					const double* wl = &tangent[left[i] * block];
+					const double dl = left_partial[i];
+					for(unsigned int l=0;l<block;l++) w[l] = dl * wl[l];
+				}
+				else{
+					const double* wl = &tangent[left[i] * block];
+					const double* wr = &tangent[right[i] * block];
+					const double dl = left_partial[i], dr = right_partial[i];
+					for(unsigned int l=0;l<block;l++) w[l] = dl * wl[l] + dr * wr[l];
+				}
+			}
+			for(unsigned int l=0;l<k;l++)
+			{
+				for(unsigned int o=0;o<m;o++)
+				{
+					const double v = tangent[outputs[o] * block + l];
+					if(v != 0) jac.add(o, first + l, v);
+				}
+			}
+		}
+	}
+	else{
+		//rows first..first+k-1, from the adjoints of the outputs
+		output_adj.resize(n * block);
+		for(unsigned int first=0;first<m;first+=block)
+		{
+			const unsigned int k = std::min(block, m - first);
+			std::fill(output_adj.begin(), output_adj.end(), 0.0);
+			for(unsigned int l=0;l<k;l++) output_adj[outputs[first + l] * block + l] += 1;
+			for(unsigned int i=n;i-- > 0;)
+			{
+				const double* a = &output_adj[i * block];
+				const int c = code[i];
+				if(c == TAPE_VAR){
+					//every user of the variable comes later, so its adjoints are final
+					for(unsigned int l=0;l<k;l++)
+					{
+						if(a[l] != 0) jac.add(first + l, left[i], a[l]);
+					}
+				}
+				else if(c != TAPE_PARAM){
+					double* al = &output_adj[left[i] * block];
+					const double dl = left_partial[i];
+					for(unsigned int l=0;l<block;l++) al[l] += dl * a[l];
+					if(right[i] != NONE){
+						double* ar = &output_adj[right[i] * block];
+						const double dr = right_partial[i];
+						for(unsigned int l=0;l<block;l++) ar[l] += dr * a[l];
+					}
+				}
+			}
+		}
+	}
+}
+
+static bool operator<(const HessEntry& a, const HessEntry& b)
+{
+	return a.col < b.col || (a.col == b.col && a.row < b.row);
+}
+
+//adds s*r to d; only the elements of d from the first variable of r on are
+//touched, so adding terms in the order of their variables is cheap
+static void add_grad(SparseDerivs& d, const SparseDerivs& r, double s)
+{
+	if(r.vars.empty()) return;
+	const unsigned int start = std::lower_bound(d.vars.begin(), d.vars.end(), r.vars.front()) - d.vars.begin();
+	const vector<unsigned int> vars(d.vars.begin() + start, d.vars.end());
+	const vector<double> grad(d.grad.begin() + start, d.grad.end());
+	d.vars.resize(start);
+	d.grad.resize(start);
+	unsigned int p = 0, q = 0;
+	while(p < vars.size() || q < r.vars.size())
+	{
+		if(q == r.vars.size() || (p < vars.size() && vars[p] < r.vars[q])){
+			d.vars.push_back(vars[p]);
+			d.grad.push_back(grad[p++]);
+		}
+		else if(p == vars.size() || r.vars[q] < vars[p]){
+			d.vars.push_back(r.vars[q]);
+			d.grad.push_back(s * r.grad[q++]);
+		}
+		else{
+			d.vars.push_back(vars[p]);
+			d.grad.push_back(grad[p++] + s * r.grad[q++]);
+		}
+	}
+}
+
+//as above, for the upper triangles of Hessians; neither h nor r may have two
+//entries at the same position
+static void add_hess(vector<HessEntry>& h, const vector<HessEntry>& r, double s)
+{
+	if(r.empty()) return;
+	const unsigned int start = std::lower_bound(h.begin(), h.end(), r.front()) - h.begin();
+	const vector<HessEntry> tail(h.begin() + start, h.end());
+	h.resize(start);
+	unsigned int p = 0, q = 0;
+	while(p < tail.size() || q < r.size())
+	{
+		if(q == r.size() || (p < tail.size() && tail[p] < r[q])){
+			h.push_back(tail[p++]);
+		}
+		else{
+			HessEntry e = r[q++];
+			e.val *= s;
+			if(p < tail.size() && !(e < tail[p])) e.val += tail[p++].val;
+			h.push_back(e);
+		}
+	}
+}
+
+//appends s * (gu gv' + gv gu') to out, folded onto the upper triangle, or
+//s * gu gu' if square
+static void outer(const SparseDerivs& u, const SparseDerivs& v, double s, bool square, vector<HessEntry>& out)
+{
+	for(unsigned int q=0;q<v.vars.size();q++)
+	{
+		for(unsigned int p=0;p<(square ? q + 1 : u.vars.size());p++)
+		{
+			const unsigned int i = u.vars[p], j = v.vars[q];
+			HessEntry e = { std::min(i,j), std::max(i,j), s * u.grad[p] * v.grad[q] };
+			if(i == j && !square) e.val *= 2;
+			out.push_back(e);
+		}
+	}
+}
+
+//the first and second partials of each operation with respect to its
+//operands are combined with the derivatives of the operands by the chain
+//rule; each touches only the variables its operands depend on
+double FlatTape::hess_forward(const double* x, SparseDerivs& out)
+{
+	assert(!code.empty());
+	forward<2>(x);
+	const unsigned int n = code.size();
+	vector<unsigned int> uses(n, 0);
+	for(unsigned int i=0;i<n;i++)
+	{
+		if(code[i] < TAPE_VAR){
+			uses[left[i]]++;
+			if(right[i] != NONE) uses[right[i]]++;
+		}
+	}
+	derivs.assign(n, SparseDerivs());
+	const SparseDerivs none;
+	vector<HessEntry> cross;
+	for(unsigned int i=0;i<n;i++)
+	{
+		SparseDerivs& d = derivs[i];
+		if(code[i] == TAPE_VAR){
+			d.vars.push_back(left[i]);
+			d.grad.push_back(1);
+		}
+		else if(code[i] < TAPE_VAR){
+			const unsigned int li = left[i], ri = right[i];
+			const SparseDerivs& r = ri != NONE ? derivs[ri] : none;
+			cross.clear();
+			if(left_left_partial[i] != 0) outer(derivs[li], derivs[li], left_left_partial[i], true, cross);
+			if(right_right_partial[i] != 0) outer(r, r, right_right_partial[i], true, cross);
+			if(left_right_partial[i] != 0) outer(derivs[li], r, left_right_partial[i], false, cross);
+			std::sort(cross.begin(), cross.end());
+			unsigned int m = 0;
+			for(unsigned int k=0;k<cross.size();k++)
+			{
+				if(m > 0 && !(cross[m-1] < cross[k])) cross[m-1].val += cross[k].val;
+				else cross[m++] = cross[k];
+			}
+			cross.resize(m);
+
+			//the derivatives of the left operand are taken over at their last
+			//use, so that a long sum is built in place
+			const double a = left_partial[i];
+			if(uses[li] == 1) d = std::move(derivs[li]);
+			else d = derivs[li];
+			if(a != 1){
+				for(unsigned int k=0;k<d.grad.size();k++) d.grad[k] *= a;
+				for(unsigned int k=0;k<d.hess.size();k++) d.hess[k].val *= a;
+			}
+			add_grad(d, r, right_partial[i]);
+			add_hess(d.hess, r.hess, right_partial[i]);
+			add_hess(d.hess, cross, 1);
+
+			if(--uses[li] == 0) derivs[li] = SparseDerivs();
+			if(ri != NONE && --uses[ri] == 0) derivs[ri] = SparseDerivs();
+		}
+	}
+	out = derivs.back();
+	derivs.back() = SparseDerivs();
+	return val.back();
+}
+}
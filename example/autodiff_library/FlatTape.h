@@ -0,0 +1,180 @@
+/*
+ * FlatTape.h
+ *
+ * A linear, structure-of-arrays alternative to the Node graph. Each entry
+ * of the tape is an independent variable, a parameter, or an operation whose
+ * operands are earlier entries, so the tape is always in topological order.
+ * Function evaluation is a single forward loop over the tape, and the
+ * gradient is a forward loop that also records the local partials, followed
+ * by a single reverse loop. Entries that are used more than once (such as
+ * variables) are visited once per sweep, so repeated subexpressions are
+ * handled correctly and cheaply.
+ *
+ * The full Hessian is computed by forward-over-reverse differentiation in
+ * blocks of directions. The values, partials and adjoints are computed once;
+ * then, for each block of up to HESS_BLOCK directions, a forward loop
+ * propagates their tangents and a reverse loop their second order adjoints.
+ * The directions of a block are stored next to each other for each entry, so
+ * the inner loops over them can use SIMD lanes.
+ *
+ * Gradients at many points are computed the same way, with the values,
+ * partials and adjoints at a block of POINT_BLOCK points stored next to each
+ * other for each entry. This does not modify the tape, so several threads can
+ * use one tape at once.
+ *
+ * grad_reverse_checkpointed() bounds the memory used for intermediates on a
+ * long tape. The tape is split into segments; the forward loop keeps only the
+ * values that later segments use, which are saved at the start of each
+ * segment, and the reverse loop recomputes one segment at a time from them.
+ * With segments of sqrt(size()) entries, and few values live across each
+ * segment boundary, this stores O(sqrt(size())) values for one extra forward
+ * loop.
+ *
+ * emit_cpp() writes the tape out as a C++ function computing the value,
+ * gradient and optionally Hessian, with one local variable per intermediate,
+ * so that a function fixed at build time needs no tape at run time.
+ *
+ * A tape may have several outputs, whose Jacobian jacobian() computes with
+ * tangents of unit directions, or adjoints of outputs, in blocks of lanes,
+ * whichever needs fewer loops.
+ *
+ * hess_forward() is a forward mode alternative, in which each entry carries
+ * the sorted indices of the variables it depends on, with its gradient and
+ * Hessian with respect to those variables only. An entry that depends on few
+ * variables is cheap, however many the tape has.
+ */
+
+#ifndef FLATTAPE_H_
+#define FLATTAPE_H_
+
+#include <vector>
+#include <limits>
+#include <ostream>
+#include <string>
+#include <boost/unordered_map.hpp>
+
+#include "auto_diff_types.h"
+
+namespace AutoDiff {
+
+using namespace std;
+
+//codes for the non-operation entries of a FlatTape; these follow the OPCODEs
+typedef enum { TAPE_VAR = OP_NEG + 1, TAPE_PARAM } TAPE_CODE;
+
+//an element of the upper triangle of a Hessian
+struct HessEntry {
+	unsigned int row;
+	unsigned int col;
+	double val;
+};
+
+//the derivatives of an entry with respect to the variables it depends on;
+//vars is sorted, and hess holds the upper triangle sorted by column, then row
+struct SparseDerivs {
+	vector<unsigned int> vars;
+	vector<double> grad;
+	vector<HessEntry> hess;
+};
+
+//receives the nonzero elements of a Jacobian from FlatTape::jacobian(), which
+//may give the same element more than once, in which case they are summed
+class JacobianSink {
+public:
+	virtual void add(unsigned int row, unsigned int col, double val) = 0;
+protected:
+	~JacobianSink() {}
+};
+
+class FlatTape {
+public:
+	static const unsigned int NONE = numeric_limits<unsigned int>::max();
+	//the default number of directions propagated together by hess_reverse()
+	static const unsigned int HESS_BLOCK = 4;
+	//the default number of points evaluated together by grad_reverse_points()
+	static const unsigned int POINT_BLOCK = 4;
+
+	FlatTape();
+
+	//tape construction; each returns the index of the new entry
+	unsigned int add_var(unsigned int var_index);
+	unsigned int add_param(double value);
+	unsigned int add_op(OPCODE op, unsigned int left, unsigned int right = NONE);
+
+	unsigned int size() const;
+	unsigned int nvars() const;
+	//makes the tape take at least n variables, whether or not they appear
+	void set_nvars(unsigned int n);
+	void clear();
+
+	//evaluates the function at x, which must hold nvars() values; the root
+	//is the last entry added
+	double eval_function(const double* x);
+	//as above, and also writes the nvars() partial derivatives to grad
+	double grad_reverse(const double* x, double* grad);
+	//as above, and writes the nvars() x nvars() Hessian to hess in column
+	//major order, using ceil(nvars()/block) forward and reverse loops
+	double hess_reverse(const double* x, double* hess, unsigned int block = HESS_BLOCK);
+	//as above, but writes the Hessian times each of the k directions in dirs
+	//(nvars() x k, column major) to hv, which is nvars() x k too
+	double hess_vec_reverse(const double* x, const double* dirs, unsigned int k, double* hv, unsigned int block = HESS_BLOCK);
+	//as grad_reverse(), but recording at most segment entries at once; 0
+	//means sqrt(size()); the largest number of values held at once is
+	//written to peak, if given
+	double grad_reverse_checkpointed(const double* x, double* grad, unsigned int segment = 0,
+			unsigned int* peak = NULL) const;
+	//evaluates the function and its gradient at each of npoints points; x
+	//holds the nvars() values of each point in turn, the values are written
+	//to f, and the gradients to grad, in the same layout as x
+	void grad_reverse_points(const double* x, unsigned int npoints, double* f, double* grad,
+			unsigned int block = POINT_BLOCK) const;
+	//evaluates the function at x, and writes its gradient and Hessian with
+	//respect to the variables it depends on to out
+	double hess_forward(const double* x, SparseDerivs& out);
+	//evaluates the m entries in outputs at x, writing their values to f, and
+	//gives the nonzero elements of the m x nvars() Jacobian to jac as each
+	//block of them is computed; this uses ceil(nvars()/block) forward loops,
+	//giving the columns in order, if nvars() <= m, and ceil(m/block) reverse
+	//loops, giving blocks of rows, otherwise
+	void jacobian(const double* x, const unsigned int* outputs, unsigned int m, double* f, JacobianSink& jac,
+			unsigned int block = HESS_BLOCK);
+
+	//writes an inline function double name(const double* x, double* grad)
+	//computing what grad_reverse() does; if hessian is true, it takes a third
+	//parameter, double* hess, and computes what hess_reverse() does
+	void emit_cpp(ostream& os, const string& name, bool hessian) const;
+
+	//one element per entry
+	vector<int> code;
+	vector<unsigned int> left;	//the variable index, for TAPE_VAR
+	vector<unsigned int> right;
+	vector<double> val;
+	//filled in by grad_reverse()
+	vector<double> left_partial;
+	vector<double> right_partial;
+	vector<double> adj;
+	//filled in by hess_reverse(); tangent and tangent_adj hold block
+	//elements per entry
+	vector<double> left_left_partial;
+	vector<double> left_right_partial;
+	vector<double> right_right_partial;
+	vector<double> tangent;
+	vector<double> tangent_adj;
+	//filled in by jacobian(), with block elements per entry
+	vector<double> output_adj;
+	//filled in by hess_forward(); an entry is cleared once all its users are
+	//done with it
+	vector<SparseDerivs> derivs;
+
+private:
+	unsigned int num_vars;
+	template<int Order> void forward(const double* x);
+	void reverse();
+	void hess_block(const double* dirs, unsigned int k, unsigned int block, double* out);
+	void eval_segment(const double* x, unsigned int start, unsigned int end,
+			const boost::unordered_map<unsigned int,double>& live, double* v, double* dl, double* dr) const;
+};
+
+}
+
+#endif /* FLATTAPE_H_ */
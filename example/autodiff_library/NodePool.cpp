@@ -0,0 +1,77 @@
+/*
+ * NodePool.cpp
+ */
+
+#include <cassert>
+
+#include "NodePool.h"
+
+namespace AutoDiff {
+
+const size_t NodePool::CHUNK_SIZE;
+
+NodePool::NodePool() : used(CHUNK_SIZE), total(0)
+{
+}
+
+NodePool::~NodePool()
+{
+	reset();
+	for(unsigned int i=0;i<chunks.size();i++)
+	{
+		delete[] chunks[i];
+	}
+}
+
+void* NodePool::allocate(size_t size)
+{
+	const size_t align = alignof(std::max_align_t);
+	size = (size + align - 1) / align * align;
+	assert(size <= CHUNK_SIZE);
+	if(chunks.empty() || used + size > CHUNK_SIZE)
+	{
+		//new char[] storage is aligned for any object that fits in it
+		chunks.push_back(new char[CHUNK_SIZE]);
+		used = 0;
+	}
+	void* p = chunks.back() + used;
+	used += size;
+	total += size;
+	return p;
+}
+
+void NodePool::reset()
+{
+	for(unsigned int i=nodes.size();i-- > 0;)
+	{
+		nodes[i]->~Node();
+	}
+	nodes.clear();
+	for(unsigned int i=1;i<chunks.size();i++)
+	{
+		delete[] chunks[i];
+	}
+	if(!chunks.empty())
+	{
+		chunks.resize(1);
+	}
+	used = 0;
+	total = 0;
+}
+
+unsigned int NodePool::size()
+{
+	return nodes.size();
+}
+
+unsigned int NodePool::numChunks()
+{
+	return chunks.size();
+}
+
+size_t NodePool::bytesUsed()
+{
+	return total;
+}
+
+}
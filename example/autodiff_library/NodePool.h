@@ -0,0 +1,64 @@
+/*
+ * NodePool.h
+ *
+ * An arena for the nodes of a graph. Nodes are placed one after another in
+ * large chunks, in the order they are created, which is a topological order
+ * of the graph, so sweeps over a graph touch memory mostly sequentially. The
+ * nodes are not freed one by one; reset() destroys all of them at once, and
+ * keeps the first chunk for the next graph.
+ */
+
+#ifndef NODEPOOL_H_
+#define NODEPOOL_H_
+
+#include <cstddef>
+#include <vector>
+
+#include "Node.h"
+
+namespace AutoDiff {
+
+using namespace std;
+
+class NodePool {
+public:
+	static const size_t CHUNK_SIZE = 64 * 1024;
+
+	NodePool();
+	~NodePool();
+
+	//returns suitably aligned storage for an object of the given size,
+	//following the storage of the previous allocation when it fits
+	void* allocate(size_t size);
+	//records a node constructed in storage returned by allocate(), so that
+	//reset() destroys it
+	template<class T> T* adopt(T* node)
+	{
+		nodes.push_back(node);
+		return node;
+	}
+	//destroys every node, and releases all chunks but the first
+	void reset();
+	unsigned int size();
+	unsigned int numChunks();
+	//the bytes of the chunks given out by allocate() since the last reset(),
+	//including alignment padding but not the unused end of each chunk
+	size_t bytesUsed();
+
+	//in creation order
+	vector<Node*> nodes;
+
+private:
+	NodePool(const NodePool&);
+	NodePool& operator=(const NodePool&);
+
+	vector<char*> chunks;
+	//bytes used in the last chunk
+	size_t used;
+	//bytes used in all chunks
+	size_t total;
+};
+
+}
+
+#endif /* NODEPOOL_H_ */
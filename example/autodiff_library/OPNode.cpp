@@ -19,7 +19,7 @@
 
 namespace AutoDiff{
 
-OPNode::OPNode(OPCODE op, Node* left) : ActNode(), op(op), left(left),val(NaN_Double) {
+OPNode::OPNode(OPCODE op, Node* left) : ActNode(), op(op), left(left),val(NaN_Double),grad_l_dh(NaN_Double) {
 }
 
 TYPE OPNode::getType()
@@ -27,11 +27,7 @@ TYPE OPNode::getType()
 	return OPNode_Type;
 }
 
+//operands may be shared with other nodes, and are released by autodiff_cleanup()
 OPNode::~OPNode() {
-	if(left->getType()!=VNode_Type)
-	{
-		delete left;
-		this->left = NULL;
-	}
 }
 }
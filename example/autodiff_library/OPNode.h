@@ -24,7 +24,9 @@ public:
 
 	OPCODE op;
 	Node* left;
+	//! value and dh/du recorded by grad_reverse_0 for grad_reverse_1
 	double val;
+	double grad_l_dh;
 
 
 
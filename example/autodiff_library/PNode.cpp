@@ -53,6 +53,7 @@ void PNode::grad_reverse_1_init_adj()
 
 void PNode::grad_reverse_1()
 {
+	n_in_arcs--;
 	//do nothing
 	//this is a parameter
 }
@@ -114,18 +115,9 @@ void PNode::hess_reverse_get_x(unsigned int i, double& x)
 
 void PNode::nonlinearEdges(EdgeSet& edges)
 {
-	for(std::list<Edge>::iterator it=edges.edges.begin();it!=edges.edges.end();)
-	{
-		Edge e = *it;
-		if(e.a == this || e.b == this)
-		{
-			it = edges.edges.erase(it); //erase invalidate the iterator
-		}
-		else
-		{
-			it++;
-		}
-	}
+	//a parameter has no second derivatives
+	std::vector<Node*> others;
+	edges.removeEdgesOf(this,others);
 }
 
 #if FORWARD_ENABLED
@@ -15,8 +15,8 @@
 namespace AutoDiff {
 
 
-Stack* Stack::vals = NULL;
-Stack* Stack::diff = NULL;
+thread_local Stack* Stack::vals = NULL;
+thread_local Stack* Stack::diff = NULL;
 
 Stack::Stack()
 {
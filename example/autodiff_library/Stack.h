@@ -28,8 +28,9 @@ public:
 
 	stack<double> lifo;
 
-	static Stack* diff;
-	static Stack* vals;
+	//per-thread, so that independent evaluations can run concurrently
+	static thread_local Stack* diff;
+	static thread_local Stack* vals;
 
 
 };
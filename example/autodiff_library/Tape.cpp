@@ -11,6 +11,6 @@
 
 namespace AutoDiff
 {
-	template<> Tape<unsigned int>* Tape<unsigned int>::indexTape = NULL;
-	template<> Tape<double>* Tape<double>::valueTape = NULL;
+	template<> thread_local Tape<unsigned int>* Tape<unsigned int>::indexTape = NULL;
+	template<> thread_local Tape<double>* Tape<double>::valueTape = NULL;
 }
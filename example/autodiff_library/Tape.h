@@ -36,11 +36,17 @@ public:
 	vector<T> vals;
 	unsigned int index;
 
-	static Tape<double>* valueTape;
-	static Tape<unsigned int>* indexTape;
+	//per-thread, so that independent evaluations can run concurrently
+	static thread_local Tape<double>* valueTape;
+	static thread_local Tape<unsigned int>* indexTape;
 };
 
 
+//declared here, so that the thread-local definitions in Tape.cpp are used
+//instead of implicit instantiations
+template<> thread_local Tape<double>* Tape<double>::valueTape;
+template<> thread_local Tape<unsigned int>* Tape<unsigned int>::indexTape;
+
 template<typename T> Tape<T>::~Tape<T>()
 {
 	index = 0;
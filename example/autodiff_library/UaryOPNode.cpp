@@ -7,6 +7,7 @@
 
 #include "UaryOPNode.h"
 #include "BinaryOPNode.h"
+#include "NodePool.h"
 #include "PNode.h"
 #include "Stack.h"
 #include "Tape.h"
@@ -23,24 +24,13 @@ namespace AutoDiff {
 UaryOPNode::UaryOPNode(OPCODE op_, Node* left): OPNode(op_,left) {
 }
 
-OPNode* UaryOPNode::createUnaryOpNode(OPCODE op, Node* left)
+//OP_SQRT and OP_NEG are lowered to binary nodes by create_uary_op_node()
+OPNode* UaryOPNode::createUnaryOpNode(OPCODE op, Node* left, NodePool& pool)
 {
 	assert(left!=NULL);
+	assert(op!=OP_SQRT && op!=OP_NEG);
 	OPNode* node = NULL;
-	if(op == OP_SQRT)
-	{
-		double param = 0.5;
-		node = BinaryOPNode::createBinaryOpNode(OP_POW,left,new PNode(param));
-	}
-	else if(op == OP_NEG)
-	{
-		double param = -1;
-		node = BinaryOPNode::createBinaryOpNode(OP_TIMES,left,new PNode(param));
-	}
-	else
-	{
-		node = new UaryOPNode(op,left);
-	}
+	node = pool.adopt(new (pool.allocate(sizeof(UaryOPNode))) UaryOPNode(op,left));
 	return node;
 }
 
@@ -75,20 +65,32 @@ void UaryOPNode::eval_function()
 //1. visiting left if not NULL
 //2. then, visiting right if not NULL
 //3. calculating the immediate derivative hu and hv
+//a shared node is only calculated on its first visit, which sets adj to 0
 void UaryOPNode::grad_reverse_0(){
 	assert(left!=NULL);
+	if(!isnan(this->adj))
+	{
+		SV->push_back(val);
+		return;
+	}
 	this->adj = 0;
 	left->grad_reverse_0();
 	this->calc_grad_reverse_0();
 }
 
 //right left - right most traversal
+//the adjoint is only propagated once it is complete, ie. when every incoming arc has been visited
 void UaryOPNode::grad_reverse_1()
 {
 	assert(left!=NULL);
-	double l_adj = SD->pop_back()*this->adj;
-	left->update_adj(l_adj);
-	left->grad_reverse_1();
+	n_in_arcs--;
+	if(n_in_arcs==0)
+	{
+		double l_adj = grad_l_dh*this->adj;
+		left->update_adj(l_adj);
+		this->adj = NaN_Double;
+		left->grad_reverse_1();
+	}
 }
 
 void UaryOPNode::calc_grad_reverse_0()
@@ -96,23 +98,24 @@ void UaryOPNode::calc_grad_reverse_0()
 	assert(left!=NULL);
 	double hu = NaN_Double;
 	double lval = SV->pop_back();
-	double val = NaN_Double;
+	double x = NaN_Double;
 	switch (op)
 	{
 	case OP_SIN:
-		val = sin(lval);
+		x = sin(lval);
 		hu = cos(lval);
 		break;
 	case OP_COS:
-		val = cos(lval);
+		x = cos(lval);
 		hu = -sin(lval);
 		break;
 	default:
 		cerr<<"error op not impl"<<endl;
 		break;
 	}
-	SV->push_back(val);
-	SD->push_back(hu);
+	val = x;
+	grad_l_dh = hu;
+	SV->push_back(x);
 }
 
 void UaryOPNode::calc_eval_function()
@@ -137,16 +140,23 @@ void UaryOPNode::calc_eval_function()
 	SV->push_back(val);
 }
 
+//counts arcs rather than paths: the operand of a shared node is only visited on its first incoming arc
 void UaryOPNode::hess_reverse_0_init_n_in_arcs()
 {
-	this->left->hess_reverse_0_init_n_in_arcs();
+	if(this->n_in_arcs==0)
+	{
+		this->left->hess_reverse_0_init_n_in_arcs();
+	}
 	this->Node::hess_reverse_0_init_n_in_arcs();
 }
 
 void UaryOPNode::hess_reverse_1_clear_index()
 {
-	this->left->hess_reverse_1_clear_index();
-	this->Node::hess_reverse_1_clear_index();
+	if(this->index!=Node::DEFAULT_INDEX)
+	{
+		this->left->hess_reverse_1_clear_index();
+		this->Node::hess_reverse_1_clear_index();
+	}
 }
 
 unsigned int UaryOPNode::hess_reverse_0()
@@ -271,25 +281,19 @@ void UaryOPNode::hess_reverse_get_x(unsigned int i, double& x)
 
 void UaryOPNode::nonlinearEdges(EdgeSet& edges)
 {
-	for(list<Edge>::iterator it=edges.edges.begin();it!=edges.edges.end();)
+	vector<Node*> others;
+	edges.removeEdgesOf(this,others);
+	for(vector<Node*>::iterator it=others.begin();it!=others.end();it++)
 	{
-		Edge& e = *it;
-		if(e.a == this || e.b == this){
-			if(e.a == this && e.b == this)
-			{
-				Edge e1(left,left);
-				edges.insertEdge(e1);
-			}
-			else{
-				Node* o = e.a==this?e.b:e.a;
-				Edge e1(left,o);
-				edges.insertEdge(e1);
-			}
-			it = edges.edges.erase(it);
-		}
-		else
+		Node* o = *it;
+		if(o == this)
 		{
-			it++;
+			Edge e1(left,left);
+			edges.insertEdge(e1);
+		}
+		else{
+			Edge e1(left,o);
+			edges.insertEdge(e1);
 		}
 	}
 
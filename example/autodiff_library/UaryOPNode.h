@@ -12,9 +12,11 @@
 
 namespace AutoDiff {
 
+class NodePool;
+
 class UaryOPNode: public OPNode {
 public:
-	static OPNode* createUnaryOpNode(OPCODE op, Node* left);
+	static OPNode* createUnaryOpNode(OPCODE op, Node* left, NodePool& pool);
 	virtual ~UaryOPNode();
 
 	void inorder_visit(int level,ostream& oss);
@@ -61,8 +61,8 @@ void VNode::grad_reverse_0()
 
 void VNode::grad_reverse_1()
 {
-	//do nothing
-	//this is a leaf node
+	n_in_arcs--;
+	//leaf node do nothing
 }
 
 #if FORWARD_ENABLED
@@ -8,13 +8,21 @@
 
 #include <iostream>
 #include <sstream>
+#include <cstdint>
+#include <cstring>
 #include <numeric>
+#include <limits>
+#include <algorithm>
+#include <thread>
 #include <boost/foreach.hpp>
+#include <boost/functional/hash.hpp>
+#include <boost/unordered_map.hpp>
 #include "autodiff.h"
 #include "Stack.h"
 #include "Tape.h"
 #include "BinaryOPNode.h"
 #include "UaryOPNode.h"
+#include "NodePool.h"
 
 using namespace std;
 
@@ -35,20 +43,81 @@ void hess_forward(Node* root, unsigned int nvar, double** hess_mat)
 #endif
 
 
+//an operator node is identified by its opcode and operands; right is NULL for unary operators
+struct OPKey
+{
+	OPCODE op;
+	Node* left;
+	Node* right;
+};
+
+bool operator==(const OPKey& a, const OPKey& b)
+{
+	return a.op == b.op && a.left == b.left && a.right == b.right;
+}
+
+size_t hash_value(const OPKey& k)
+{
+	size_t seed = 0;
+	boost::hash_combine(seed,k.op);
+	boost::hash_combine(seed,k.left);
+	boost::hash_combine(seed,k.right);
+	return seed;
+}
+
+//a parameter node is identified by the bits of its value, so that 0.0 and -0.0
+//are different parameters, and a NaN is the same parameter as itself
+static std::uint64_t param_key(double value)
+{
+	std::uint64_t key;
+	std::memcpy(&key,&value,sizeof(key));
+	return key;
+}
+
+//the nodes created by the calling thread, and the parameter and operator nodes among them
+static thread_local NodePool pool;
+static thread_local boost::unordered_map<std::uint64_t,PNode*> param_nodes;
+static thread_local boost::unordered_map<OPKey,OPNode*> op_nodes;
+
 PNode* create_param_node(double value){
-	return new PNode(value);
+	PNode*& node = param_nodes[param_key(value)];
+	if(node==NULL)
+	{
+		node = pool.adopt(new (pool.allocate(sizeof(PNode))) PNode(value));
+	}
+	return node;
 }
 VNode* create_var_node(double v)
 {
-	return new VNode(v);
+	return pool.adopt(new (pool.allocate(sizeof(VNode))) VNode(v));
 }
 OPNode* create_binary_op_node(OPCODE code, Node* left, Node* right)
 {
-	return BinaryOPNode::createBinaryOpNode(code,left,right);
+	OPKey key = {code,left,right};
+	OPNode*& node = op_nodes[key];
+	if(node==NULL)
+	{
+		node = BinaryOPNode::createBinaryOpNode(code,left,right,pool);
+	}
+	return node;
 }
 OPNode* create_uary_op_node(OPCODE code, Node* left)
 {
-	return UaryOPNode::createUnaryOpNode(code,left);
+	if(code == OP_SQRT)
+	{
+		return create_binary_op_node(OP_POW,left,create_param_node(0.5));
+	}
+	if(code == OP_NEG)
+	{
+		return create_binary_op_node(OP_TIMES,left,create_param_node(-1));
+	}
+	OPKey key = {code,left,NULL};
+	OPNode*& node = op_nodes[key];
+	if(node==NULL)
+	{
+		node = UaryOPNode::createUnaryOpNode(code,left,pool);
+	}
+	return node;
 }
 double eval_function(Node* root)
 {
@@ -70,10 +139,13 @@ double grad_reverse(Node* root,vector<Node*>& vnodes, vector<double>& grad)
 	}
 
 	assert(SD->size()==0);
+	assert(root->n_in_arcs == 0);
+	root->hess_reverse_0_init_n_in_arcs();
 	root->grad_reverse_0();
 	assert(SV->size()==1);
 	root->grad_reverse_1_init_adj();	
 	root->grad_reverse_1();
+	assert(root->n_in_arcs == 0);
 	assert(SD->size()==0);
 	double val = SV->pop_back();
 	assert(SV->size()==0);
@@ -97,10 +169,13 @@ double grad_reverse(Node* root, vector<Node*>& vnodes, col_compress_matrix_row&
 		static_cast<VNode*>(node)->adj = NaN_Double;
 	}
 	assert(SD->size()==0);
+	assert(root->n_in_arcs == 0);
+	root->hess_reverse_0_init_n_in_arcs();
 	root->grad_reverse_0();
 	assert(SV->size()==1);
 	root->grad_reverse_1_init_adj();
 	root->grad_reverse_1();
+	assert(root->n_in_arcs == 0);
 	assert(SD->size()==0);
 	double val = SV->pop_back();
 	assert(SV->size()==0);
@@ -226,6 +301,348 @@ double hess_reverse(Node* root,vector<Node*>& vnodes,col_compress_matrix_col& ch
 	return val;
 }
 
+//adds the entries computing the full Hessian of root to the Hessian of the
+//multiple constraints in hess; nodes[i] is the i-th row and column
+double hess_reverse(Node* root, vector<Node*>& nodes, col_compress_matrix& hess, unsigned int block)
+{
+	FlatTape tape;
+	flat_tape(root,nodes,tape);
+	unsigned int nvars = tape.nvars();
+	if(nvars==0)
+	{
+		return tape.eval_function(NULL);
+	}
+	vector<double> x(nvars);
+	for(unsigned int i=0;i<nvars;i++)
+	{
+		assert(nodes[i]->getType()==VNode_Type);
+		x[i] = static_cast<VNode*>(nodes[i])->val;
+	}
+	vector<double> h(nvars*nvars);
+	double val = tape.hess_reverse(&x[0],&h[0],block);
+	for(unsigned int j=0;j<nvars;j++)
+	{
+		for(unsigned int i=0;i<nvars;i++)
+		{
+			double v = h[j*nvars+i];
+			if(v!=0)
+			{
+				hess(i,j) = hess(i,j) + v;
+			}
+		}
+	}
+	return val;
+}
+
+static bool hess_entry_less(const HessEntry& a, const HessEntry& b)
+{
+	return a.col < b.col || (a.col == b.col && a.row < b.row);
+}
+
+//dependency-aware forward mode; grad has one element per element of nodes,
+//and both triangles of the Hessian are added to hess
+double hess_forward(Node* root, vector<Node*>& nodes, vector<double>& grad, col_compress_matrix& hess)
+{
+	FlatTape tape;
+	flat_tape(root,nodes,tape);
+	unsigned int nvars = tape.nvars();
+	grad.assign(nvars,0.0);
+	if(nvars==0)
+	{
+		return tape.eval_function(NULL);
+	}
+	vector<double> x(nvars);
+	for(unsigned int i=0;i<nvars;i++)
+	{
+		assert(nodes[i]->getType()==VNode_Type);
+		x[i] = static_cast<VNode*>(nodes[i])->val;
+	}
+	SparseDerivs d;
+	double val = tape.hess_forward(&x[0],d);
+	for(unsigned int k=0;k<d.vars.size();k++)
+	{
+		grad[d.vars[k]] = d.grad[k];
+	}
+	//both triangles, inserted column by column
+	vector<HessEntry> entries(d.hess);
+	for(unsigned int k=0;k<d.hess.size();k++)
+	{
+		if(d.hess[k].row!=d.hess[k].col)
+		{
+			HessEntry e = { d.hess[k].col, d.hess[k].row, d.hess[k].val };
+			entries.push_back(e);
+		}
+	}
+	std::sort(entries.begin(),entries.end(),hess_entry_less);
+	for(unsigned int k=0;k<entries.size();k++)
+	{
+		const HessEntry& e = entries[k];
+		hess(e.row,e.col) = hess(e.row,e.col) + e.val;
+	}
+	return val;
+}
+
+//greedy distance-2 colouring: the nonzero rows of column n are the neighbours
+//of n in edges, so two columns conflict when they have a neighbour in common
+unsigned int hess_coloring(EdgeSet& edges, vector<Node*>& nodes, vector<unsigned int>& colors)
+{
+	boost::unordered_map<Node*,unsigned int> index;
+	for(unsigned int i=0;i<nodes.size();i++)
+	{
+		index[nodes[i]] = i;
+	}
+	const unsigned int none = numeric_limits<unsigned int>::max();
+	colors.assign(nodes.size(),none);
+	//forbidden[c] == i+1 when colour c is used by a column conflicting with column i
+	vector<unsigned int> forbidden;
+	for(unsigned int i=0;i<nodes.size();i++)
+	{
+		EdgeSet::Adjacency::iterator col = edges.neighbours.find(nodes[i]);
+		if(col!=edges.neighbours.end())
+		{
+			BOOST_FOREACH(Node* r, col->second)
+			{
+				BOOST_FOREACH(Node* k, edges.neighbours[r])
+				{
+					boost::unordered_map<Node*,unsigned int>::iterator it = index.find(k);
+					if(it!=index.end() && colors[it->second]!=none)
+					{
+						forbidden[colors[it->second]] = i+1;
+					}
+				}
+			}
+		}
+		unsigned int c = 0;
+		while(c<forbidden.size() && forbidden[c]==i+1)
+		{
+			c++;
+		}
+		if(c==forbidden.size())
+		{
+			forbidden.push_back(0);
+		}
+		colors[i] = c;
+	}
+	return forbidden.size();
+}
+
+//computes the entries of the Hessian in the sparsity pattern found by nonlinearEdges, from one Hessian*vector
+//product per colour, and adds them to hess
+double hess_reverse_sparse(Node* root, vector<Node*>& nodes, col_compress_matrix& hess, unsigned int block)
+{
+	FlatTape tape;
+	flat_tape(root,nodes,tape);
+	unsigned int nvars = tape.nvars();
+	if(nvars==0)
+	{
+		return tape.eval_function(NULL);
+	}
+	vector<double> x(nvars);
+	for(unsigned int i=0;i<nvars;i++)
+	{
+		assert(nodes[i]->getType()==VNode_Type);
+		x[i] = static_cast<VNode*>(nodes[i])->val;
+	}
+
+	EdgeSet edges;
+	nonlinearEdges(root,edges);
+	if(edges.size()==0)
+	{
+		return tape.eval_function(&x[0]);
+	}
+	vector<unsigned int> colors;
+	unsigned int ncolors = hess_coloring(edges,nodes,colors);
+
+	//direction c is the sum of the unit directions of the columns coloured c
+	vector<double> dirs(nvars*ncolors);
+	for(unsigned int i=0;i<nvars;i++)
+	{
+		dirs[colors[i]*nvars+i] = 1;
+	}
+	vector<double> hv(nvars*ncolors);
+	double val = tape.hess_vec_reverse(&x[0],&dirs[0],ncolors,&hv[0],block);
+
+	boost::unordered_map<Node*,unsigned int> index;
+	for(unsigned int i=0;i<nvars;i++)
+	{
+		index[nodes[i]] = i;
+	}
+	vector<Edge> pattern;
+	edges.getEdges(pattern);
+	BOOST_FOREACH(Edge& e, pattern)
+	{
+		assert(index.find(e.a)!=index.end() && index.find(e.b)!=index.end());
+		unsigned int i = index[e.a];
+		unsigned int j = index[e.b];
+		hess(i,j) = hess(i,j) + hv[colors[j]*nvars+i];
+		if(i!=j)
+		{
+			hess(j,i) = hess(j,i) + hv[colors[i]*nvars+j];
+		}
+	}
+	return val;
+}
+
+static unsigned int flat_tape_entry(Node* node, boost::unordered_map<Node*,unsigned int>& vars,
+		boost::unordered_map<Node*,unsigned int>& entries, FlatTape& tape)
+{
+	boost::unordered_map<Node*,unsigned int>::iterator it = entries.find(node);
+	if(it!=entries.end())
+	{
+		return it->second;
+	}
+	unsigned int entry = FlatTape::NONE;
+	if(node->getType()==VNode_Type)
+	{
+		it = vars.find(node);
+		assert(it!=vars.end());
+		entry = tape.add_var(it->second);
+	}
+	else if(node->getType()==PNode_Type)
+	{
+		entry = tape.add_param(static_cast<PNode*>(node)->pval);
+	}
+	else
+	{
+		OPNode* op = static_cast<OPNode*>(node);
+		unsigned int left = flat_tape_entry(op->left,vars,entries,tape);
+		if(op->op==OP_SIN || op->op==OP_COS)
+		{
+			entry = tape.add_op(op->op,left);
+		}
+		else
+		{
+			unsigned int right = flat_tape_entry(static_cast<BinaryOPNode*>(op)->right,vars,entries,tape);
+			entry = tape.add_op(op->op,left,right);
+		}
+	}
+	entries[node] = entry;
+	return entry;
+}
+
+//appends the graph under root to tape, with one entry per distinct node, and
+//returns the index of the entry of root; nodes[i] becomes variable i
+unsigned int flat_tape(Node* root, vector<Node*>& nodes, FlatTape& tape)
+{
+	boost::unordered_map<Node*,unsigned int> vars;
+	for(unsigned int i=0;i<nodes.size();i++)
+	{
+		vars[nodes[i]] = i;
+	}
+	boost::unordered_map<Node*,unsigned int> entries;
+	unsigned int entry = flat_tape_entry(root,vars,entries,tape);
+	tape.set_nvars(nodes.size());
+	return entry;
+}
+
+//as grad_reverse, but on the FlatTape of root, which is evaluated and
+//differentiated segment entries at a time
+double grad_reverse_checkpointed(Node* root, vector<Node*>& nodes, vector<double>& grad, unsigned int segment)
+{
+	FlatTape tape;
+	flat_tape(root,nodes,tape);
+	unsigned int nvars = tape.nvars();
+	grad.assign(nvars,0.0);
+	vector<double> x(nvars);
+	for(unsigned int i=0;i<nvars;i++)
+	{
+		assert(nodes[i]->getType()==VNode_Type);
+		x[i] = static_cast<VNode*>(nodes[i])->val;
+	}
+	if(nvars==0)
+	{
+		return tape.grad_reverse_checkpointed(NULL,NULL,segment);
+	}
+	return tape.grad_reverse_checkpointed(&x[0],&grad[0],segment);
+}
+
+//as above, for several roots sharing one tape; the index of the entry of
+//each root is written to outputs
+void flat_tape(vector<Node*>& roots, vector<Node*>& nodes, FlatTape& tape, vector<unsigned int>& outputs)
+{
+	boost::unordered_map<Node*,unsigned int> vars;
+	for(unsigned int i=0;i<nodes.size();i++)
+	{
+		vars[nodes[i]] = i;
+	}
+	boost::unordered_map<Node*,unsigned int> entries;
+	outputs.clear();
+	for(unsigned int i=0;i<roots.size();i++)
+	{
+		outputs.push_back(flat_tape_entry(roots[i],vars,entries,tape));
+	}
+	tape.set_nvars(nodes.size());
+}
+
+//adds the elements given by FlatTape::jacobian() to a matrix
+class MatrixSink : public JacobianSink {
+public:
+	MatrixSink(col_compress_matrix& m) : mat(m) {}
+	void add(unsigned int row, unsigned int col, double val)
+	{
+		mat(row,col) = mat(row,col) + val;
+	}
+private:
+	col_compress_matrix& mat;
+};
+
+//the roots are lowered onto one tape, so subexpressions they share are
+//differentiated once
+void jacobian(vector<Node*>& roots, vector<Node*>& nodes, vector<double>& vals, col_compress_matrix& jac,
+		unsigned int block)
+{
+	FlatTape tape;
+	vector<unsigned int> outputs;
+	flat_tape(roots,nodes,tape,outputs);
+	const unsigned int m = roots.size();
+	const unsigned int nvars = tape.nvars();
+	vals.resize(m);
+	if(m==0)
+	{
+		return;
+	}
+	vector<double> x(nvars);
+	for(unsigned int i=0;i<nvars;i++)
+	{
+		assert(nodes[i]->getType()==VNode_Type);
+		x[i] = static_cast<VNode*>(nodes[i])->val;
+	}
+	MatrixSink sink(jac);
+	tape.jacobian(nvars==0 ? NULL : &x[0],&outputs[0],m,&vals[0],sink,block);
+}
+
+//splits the points into one contiguous range per thread, each a multiple of the block of points evaluated together
+void grad_reverse_points(Node* root, vector<Node*>& nodes, const double* x, unsigned int npoints, double* f,
+		double* grad, unsigned int nthreads)
+{
+	FlatTape tape;
+	flat_tape(root,nodes,tape);
+	const unsigned int nvars = tape.nvars();
+	if(nthreads==0)
+	{
+		nthreads = std::max(std::thread::hardware_concurrency(),1u);
+	}
+	const unsigned int block = FlatTape::POINT_BLOCK;
+	unsigned int per_thread = (npoints + nthreads - 1) / nthreads;
+	per_thread = std::max((per_thread + block - 1) / block * block, block);
+	if(npoints <= per_thread)
+	{
+		tape.grad_reverse_points(x,npoints,f,grad);
+		return;
+	}
+	vector<std::thread> workers;
+	for(unsigned int first=0;first<npoints;first+=per_thread)
+	{
+		unsigned int count = std::min(per_thread,npoints-first);
+		workers.push_back(std::thread(&FlatTape::grad_reverse_points,&tape,x+first*nvars,count,f+first,
+				grad+first*nvars,block));
+	}
+	for(unsigned int i=0;i<workers.size();i++)
+	{
+		workers[i].join();
+	}
+}
+
 unsigned int nzGrad(Node* root)
 {
 	unsigned int nzgrad,total = 0;
@@ -262,22 +679,21 @@ void nonlinearEdges(Node* root, EdgeSet& edges)
 
 unsigned int nzHess(EdgeSet& eSet,boost::unordered_set<Node*>& set1, boost::unordered_set<Node*>& set2)
 {
-	list<Edge>::iterator i = eSet.edges.begin();
-	for(;i!=eSet.edges.end();)
+	vector<Edge> edges;
+	eSet.getEdges(edges);
+	for(vector<Edge>::iterator i=edges.begin();i!=edges.end();i++)
 	{
-		Edge e =*i;
-		Node* a = e.a;
-		Node* b = e.b;
+		Node* a = i->a;
+		Node* b = i->b;
 		if((set1.find(a)!=set1.end() && set2.find(b)!=set2.end())
 			||
 			(set1.find(b)!=set1.end() && set2.find(a)!=set2.end()))
 		{
 			//e is connected between set1 and set2
-			i++;
 		}
 		else
 		{
-			i = eSet.edges.erase(i);
+			eSet.removeEdge(*i);
 		}
 	}
 	unsigned int diag=eSet.numSelfEdges();
@@ -316,6 +732,7 @@ void print_tree(Node* root)
 	root->inorder_visit(level,cout);
 }
 
+//sets up the tapes and stacks of the calling thread
 void autodiff_setup()
 {
 	Stack::diff = new Stack();
@@ -324,8 +741,23 @@ void autodiff_setup()
 	Tape<double>::valueTape = new Tape<double>();
 }
 
+NodePool& node_pool()
+{
+	return pool;
+}
+
+//releases every node created by the calling thread at once
+void reset_nodes()
+{
+	op_nodes.clear();
+	param_nodes.clear();
+	pool.reset();
+}
+
+//releases the tapes and stacks of the calling thread, and the nodes it created
 void autodiff_cleanup()
 {
+	reset_nodes();
 	delete Stack::diff;
 	delete Stack::vals;
 	delete Tape<unsigned int>::indexTape;
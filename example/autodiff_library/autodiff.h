@@ -20,6 +20,8 @@
 #include "PNode.h"
 #include "ActNode.h"
 #include "EdgeSet.h"
+#include "FlatTape.h"
+#include "NodePool.h"
 
 
 /*
@@ -31,6 +33,7 @@
  * 			Gradient evaluation use two stack.
  * Disadvantage for tapeless:
  * 			Inefficient if the expression tree have repeated nodes.
+ * 			(This is avoided by the node creation methods, see Shared Subexpressions below.)
  * 			for example:
  * 						 root
  * 						 /  \
@@ -65,12 +68,70 @@
  * By default the forward mode hessian routing is disabled. To enable the forward hessian interface, the
  * compiler marco FORWARD_ENABLED need to be set equal to 1 in auto_diff_types.h
  *
+ * + Dependency-Aware Forward Hessian Evaluation:
+ * The other forward Hessian routine (always enabled) lowers the graph onto a FlatTape, and has each entry carry
+ * the sorted indices of the variables it depends on, with its gradient and the upper triangle of its Hessian
+ * stored for those variables only. The chain rule at each entry then touches only the variables its operands
+ * depend on, so a term of a few variables costs the same however many variables the function has. The gradient
+ * and both triangles of the Hessian are returned.
+ *
  * + Reverse Hessian*Vector Evaluation:
  * Simple, building a tape in the forward pass, and a reverse pass will evaluate the Hessian*vector. The implemenation
  * also discovery the repeated subexpression and use one piece of memory on the tape for the same subexpression. This
  * allow efficient evaluation, because the repeated subexpression only evaluate once in the forward and reverse pass.
  * This algorithm can be called n times to compute a full Hessian, where n equals the number of independent
  * variables.
+ *
+ * + Full Hessian Evaluation:
+ * Calling the Hessian*vector routine n times redoes the forward pass n times. Instead, the full Hessian routine
+ * lowers the graph onto a FlatTape, evaluates the values, partials and adjoints once, and then propagates blocks of
+ * k unit directions together, in ceil(n/k) forward (tangent) and reverse (second order adjoint) loops. The k
+ * directions are stored as adjacent lanes, so these loops vectorize. See FlatTape.h.
+ *
+ * + Checkpointed Gradient Evaluation:
+ * The Tape used by the reverse Hessian routines records every intermediate. For very long computations, the
+ * checkpointed gradient routine lowers the graph onto a FlatTape and splits it into segments of a given number of
+ * entries (by default, the square root of the number of entries). The forward sweep saves only the values that
+ * are used across each segment boundary, and the reverse sweep recomputes each segment from them before
+ * propagating its adjoints. When few values cross each boundary, this holds O(sqrt(n)) values, at the cost of
+ * a second forward sweep.
+ *
+ * + Jacobian Evaluation:
+ * The Jacobian routine takes the roots of a vector valued function, lowers them onto one FlatTape, so that the
+ * subexpressions they share appear once, and adds the nonzero entries of the m x n Jacobian to a matrix. With no
+ * more variables than outputs, the tangents of blocks of unit directions are propagated forward, one column per
+ * direction; otherwise the adjoints of blocks of outputs are propagated in reverse, one row per output.
+ *
+ * + Gradients at Many Points:
+ * The multiple point gradient routine lowers the graph onto a FlatTape once, and evaluates the function and its
+ * gradient at blocks of points, with the values and adjoints at the points of a block stored as adjacent lanes.
+ * The points are split among nthreads threads (by default, one per hardware thread), which share the tape. The
+ * points are given one after another, with one value per element of nodes; the gradients have the same layout.
+ *
+ * + Sparse Hessian Evaluation:
+ * The nonlinear edges collected by nonlinearEdges give the sparsity pattern of the Hessian, and are kept in an
+ * EdgeSet that stores the neighbours of each node in hash sets. The sparse Hessian routine colours the columns of
+ * that pattern so that columns of the same colour have no nonzero row in common (hess_coloring), and sums the unit
+ * directions of each colour into one direction. Each entry of the pattern is then read directly from one of the
+ * Hessian*vector products of these directions, so the number of products is the number of colours rather than n.
+ *
+ * + Shared Subexpressions:
+ * create_param_node, create_uary_op_node and create_binary_op_node are hash-consed. A parameter node is
+ * identified by its value, and an operator node by its opcode and operand nodes, so creating the same
+ * subexpression twice returns the same node, and a graph is built as a DAG. grad_reverse and hess_reverse
+ * count the incoming arcs of each node, and visit a shared node once, after all its parents.
+ * As nodes may be shared, a node does not own its operands; every node is owned by its NodePool (see below).
+ *
+ * + Node Allocation:
+ * All nodes, including variable nodes, are allocated from a NodePool owned by the thread that created them
+ * (see node_pool()). The pool places nodes contiguously in creation order, which is a topological order, and
+ * releases them all at once in reset_nodes(), which autodiff_cleanup() also calls. Do not delete nodes.
+ *
+ * + Threading:
+ * The tapes and stacks used by the evaluation routines are per-thread. Each thread that evaluates or
+ * differentiates must call autodiff_setup() before, and autodiff_cleanup() after. Independent graphs can then be
+ * evaluated concurrently on different threads. The nodes of a graph hold evaluation state (values, adjoints,
+ * tape indices), so a single graph must not be used by more than one thread at a time.
  * */
 
 typedef boost::numeric::ublas::compressed_matrix<double,boost::numeric::ublas::column_major,0,std::vector<std::size_t>,std::vector<double> >  col_compress_matrix;
@@ -97,17 +158,31 @@ namespace AutoDiff{
 	extern double grad_reverse(Node* root, vector<Node*>& nodes, col_compress_matrix_row& rgrad);
 	extern unsigned int nzHess(EdgeSet&,boost::unordered_set<Node*>& set1, boost::unordered_set<Node*>& set2);
 	extern double hess_reverse(Node* root, vector<Node*>& nodes, col_compress_matrix_col& chess);
+	extern double hess_reverse(Node* root, vector<Node*>& nodes, col_compress_matrix& hess, unsigned int block = FlatTape::HESS_BLOCK);
+	extern void grad_reverse_points(Node* root, vector<Node*>& nodes, const double* x, unsigned int npoints,
+			double* f, double* grad, unsigned int nthreads = 0);
+	extern double grad_reverse_checkpointed(Node* root, vector<Node*>& nodes, vector<double>& grad,
+			unsigned int segment = 0);
+	extern double hess_forward(Node* root, vector<Node*>& nodes, vector<double>& grad, col_compress_matrix& hess);
+	extern void jacobian(vector<Node*>& roots, vector<Node*>& nodes, vector<double>& vals, col_compress_matrix& jac,
+			unsigned int block = FlatTape::HESS_BLOCK);
+	extern double hess_reverse_sparse(Node* root, vector<Node*>& nodes, col_compress_matrix& hess, unsigned int block = FlatTape::HESS_BLOCK);
 
-#if FORWARD_ENDABLED
+#if FORWARD_ENABLED
 	//forward methods
 	extern void hess_forward(Node* root, unsigned int nvar, double** hess_mat);
 #endif
 
 	//utiliy methods
+	extern unsigned int flat_tape(Node* root, vector<Node*>& nodes, FlatTape& tape);
+	extern void flat_tape(vector<Node*>& roots, vector<Node*>& nodes, FlatTape& tape, vector<unsigned int>& outputs);
+	extern unsigned int hess_coloring(EdgeSet& edges, vector<Node*>& nodes, vector<unsigned int>& colors);
 	extern void nonlinearEdges(Node* root, EdgeSet& edges);
 	extern unsigned int numTotalNodes(Node*);
 	extern string tree_expr(Node* root);
 	extern void print_tree(Node* root);
+	extern NodePool& node_pool();
+	extern void reset_nodes();
 	extern void autodiff_setup();
 	extern void autodiff_cleanup();
 };
@@ -0,0 +1,137 @@
+// Copyright (C) 2016-2018 T. Zachary Laine
+//
+// Distributed under the Boost Software License, Version 1.0. (See
+// accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+#ifndef AUTODIFF_EXPR_HPP_INCLUDED
+#define AUTODIFF_EXPR_HPP_INCLUDED
+
+// The Yap expression template for Autodiff expressions, and the transform
+// that builds the Node graph of one, shared by autodiff_example.cpp,
+// autodiff_codegen.cpp and perf/autodiff_perf.cpp.
+
+#include "autodiff.h"
+
+#include <cassert>
+#include <vector>
+
+#include <boost/yap/algorithm.hpp>
+
+
+//[ autodiff_expr_template_decl
+template <boost::yap::expr_kind Kind, typename Tuple>
+struct autodiff_expr
+{
+    static boost::yap::expr_kind const kind = Kind;
+
+    Tuple elements;
+};
+
+BOOST_YAP_USER_UNARY_OPERATOR(negate, autodiff_expr, autodiff_expr)
+
+BOOST_YAP_USER_BINARY_OPERATOR(plus, autodiff_expr, autodiff_expr)
+BOOST_YAP_USER_BINARY_OPERATOR(minus, autodiff_expr, autodiff_expr)
+BOOST_YAP_USER_BINARY_OPERATOR(multiplies, autodiff_expr, autodiff_expr)
+BOOST_YAP_USER_BINARY_OPERATOR(divides, autodiff_expr, autodiff_expr)
+//]
+
+//[ autodiff_expr_literals_decl
+namespace autodiff_placeholders {
+
+    // This defines a placeholder literal operator that creates autodiff_expr
+    // placeholders.
+    BOOST_YAP_USER_LITERAL_PLACEHOLDER_OPERATOR(autodiff_expr)
+
+}
+//]
+
+//[ autodiff_function_terminals
+template <AutoDiff::OPCODE Opcode>
+struct autodiff_fn_expr :
+    autodiff_expr<boost::yap::expr_kind::terminal, boost::hana::tuple<AutoDiff::OPCODE>>
+{
+    autodiff_fn_expr () :
+        autodiff_expr {boost::hana::tuple<AutoDiff::OPCODE>{Opcode}}
+    {}
+
+    BOOST_YAP_USER_CALL_OPERATOR_N(::autodiff_expr, 1);
+};
+
+// Someone included <math.h>, so we have to add trailing underscores.
+autodiff_fn_expr<AutoDiff::OP_SIN> const sin_;
+autodiff_fn_expr<AutoDiff::OP_COS> const cos_;
+autodiff_fn_expr<AutoDiff::OP_SQRT> const sqrt_;
+//]
+
+//[ autodiff_xform
+struct xform
+{
+    // Create a var-node for each placeholder when we see it for the first
+    // time.
+    template <long long I>
+    AutoDiff::Node * operator() (boost::yap::expr_tag<boost::yap::expr_kind::terminal>,
+                                 boost::yap::placeholder<I>)
+    {
+        if (list_.size() < I)
+            list_.resize(I);
+        auto & retval = list_[I - 1];
+        if (retval == nullptr)
+            retval = AutoDiff::create_var_node();
+        return retval;
+    }
+
+    // Create a param-node for every numeric terminal in the expression.
+    AutoDiff::Node * operator() (boost::yap::expr_tag<boost::yap::expr_kind::terminal>, double x)
+    { return AutoDiff::create_param_node(x); }
+
+    // Create a "uary" node for each call expression, using its OPCODE.
+    template <typename Expr>
+    AutoDiff::Node * operator() (boost::yap::expr_tag<boost::yap::expr_kind::call>,
+                                 AutoDiff::OPCODE opcode, Expr const & expr)
+    {
+        return AutoDiff::create_uary_op_node(
+            opcode,
+            boost::yap::transform(boost::yap::as_expr<autodiff_expr>(expr), *this)
+        );
+    }
+
+    template <typename Expr>
+    AutoDiff::Node * operator() (boost::yap::expr_tag<boost::yap::expr_kind::negate>,
+                                 Expr const & expr)
+    {
+        return AutoDiff::create_uary_op_node(
+            AutoDiff::OP_NEG,
+            boost::yap::transform(boost::yap::as_expr<autodiff_expr>(expr), *this)
+        );
+    }
+
+    // Define a mapping from binary arithmetic expr_kind to OPCODE...
+    static AutoDiff::OPCODE op_for_kind (boost::yap::expr_kind kind)
+    {
+        switch (kind) {
+        case boost::yap::expr_kind::plus: return AutoDiff::OP_PLUS;
+        case boost::yap::expr_kind::minus: return AutoDiff::OP_MINUS;
+        case boost::yap::expr_kind::multiplies: return AutoDiff::OP_TIMES;
+        case boost::yap::expr_kind::divides: return AutoDiff::OP_DIVID;
+        default: assert(!"This should never execute"); return AutoDiff::OPCODE{};
+        }
+        assert(!"This should never execute");
+        return AutoDiff::OPCODE{};
+    }
+
+    // ... and use it to handle all the binary arithmetic operators.
+    template <boost::yap::expr_kind Kind, typename Expr1, typename Expr2>
+    AutoDiff::Node * operator() (boost::yap::expr_tag<Kind>, Expr1 const & expr1, Expr2 const & expr2)
+    {
+        return AutoDiff::create_binary_op_node(
+            op_for_kind(Kind),
+            boost::yap::transform(boost::yap::as_expr<autodiff_expr>(expr1), *this),
+            boost::yap::transform(boost::yap::as_expr<autodiff_expr>(expr2), *this)
+        );
+    }
+
+    std::vector<AutoDiff::Node *> & list_;
+};
+//]
+
+#endif
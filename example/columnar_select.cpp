@@ -0,0 +1,957 @@
+// Copyright (C) 2016-2018 T. Zachary Laine
+//
+// Distributed under the Boost Software License, Version 1.0. (See
+// accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+//[ columnar_select
+#include <boost/yap/yap.hpp>
+
+#include <boost/hana/concat.hpp>
+#include <boost/hana/size.hpp>
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <type_traits>
+#include <vector>
+
+
+// Rows are processed in batches of this many, so that the selection vectors
+// and the slices of the columns being read stay in cache.
+constexpr std::size_t batch_size = 1024;
+
+// Turns each column (std::vector) terminal into a terminal containing the
+// value in row n.
+struct take_nth
+{
+    template <typename T>
+    auto operator() (boost::yap::expr_tag<boost::yap::expr_kind::terminal>,
+                     std::vector<T> const & column)
+    { return boost::yap::make_terminal(column[n]); }
+
+    std::size_t n;
+};
+
+// A stateful transform that records the size of the first column it sees,
+// and whether all the others have the same size.
+struct extent_impl
+{
+    template <typename T>
+    auto operator() (boost::yap::expr_tag<boost::yap::expr_kind::terminal>,
+                     std::vector<T> const & column)
+    {
+        if (!seen_column) {
+            size = column.size();
+            seen_column = true;
+        } else if (column.size() != size) {
+            equal_sizes = false;
+        }
+        return 0;
+    }
+
+    std::size_t size;
+    bool seen_column;
+    bool equal_sizes;
+};
+
+
+// A selection vector: the ascending indices of the rows still under
+// consideration.
+struct selection
+{
+    std::uint32_t * rows;
+    std::size_t size;
+};
+
+// Selection vectors for intermediate results, each batch_size long.  They are
+// handed out and returned in stack order, and are reused for every batch.
+struct scratch_pool
+{
+    std::uint32_t * acquire ()
+    {
+        if (used == buffers.size())
+            buffers.emplace_back(batch_size);
+        return buffers[used++].data();
+    }
+
+    void release (std::size_t n)
+    { used -= n; }
+
+    std::deque<std::vector<std::uint32_t>> buffers;
+    std::size_t used;
+};
+
+// Writes the rows of in that are not in the subset passed to out, and returns
+// how many there are.  Unlike std::set_difference(), out may be the same as
+// in.rows.
+inline std::size_t
+difference (selection in, selection passed, std::uint32_t * out)
+{
+    std::size_t n = 0;
+    std::size_t j = 0;
+    for (std::size_t i = 0; i < in.size; ++i) {
+        std::uint32_t const row = in.rows[i];
+        while (j < passed.size && passed.rows[j] < row) {
+            ++j;
+        }
+        out[n] = row;
+        n += j == passed.size || passed.rows[j] != row;
+    }
+    return n;
+}
+
+// Writes the rows of in for which predicate is true to out, and returns how
+// many there are.  The selection is compacted without branching on the
+// predicate; every row is written, but out only advances past the ones that
+// pass.  This is safe to do in place, since the write position never passes
+// the read position.  This version works for any predicate, by evaluating it
+// one row at a time.
+template <typename Expr>
+std::size_t refine_leaf_by_row (Expr const & predicate, selection in,
+                                std::uint32_t * out)
+{
+    std::size_t n = 0;
+    for (std::size_t i = 0; i < in.size; ++i) {
+        std::uint32_t const row = in.rows[i];
+        out[n] = row;
+        n += static_cast<bool>(boost::yap::evaluate(
+            boost::yap::transform(predicate, take_nth{row})));
+    }
+    return n;
+}
+
+template <typename Expr>
+std::size_t refine_leaf (Expr const & predicate, selection in, std::uint32_t * out)
+{ return refine_leaf_by_row(predicate, in, out); }
+
+// The comparison operators that have a columnar kernel.
+template <boost::yap::expr_kind Kind>
+struct comparison_op {};
+
+template <>
+struct comparison_op<boost::yap::expr_kind::less>
+{ using type = std::less<>; };
+template <>
+struct comparison_op<boost::yap::expr_kind::less_equal>
+{ using type = std::less_equal<>; };
+template <>
+struct comparison_op<boost::yap::expr_kind::greater>
+{ using type = std::greater<>; };
+template <>
+struct comparison_op<boost::yap::expr_kind::greater_equal>
+{ using type = std::greater_equal<>; };
+template <>
+struct comparison_op<boost::yap::expr_kind::equal_to>
+{ using type = std::equal_to<>; };
+template <>
+struct comparison_op<boost::yap::expr_kind::not_equal_to>
+{ using type = std::not_equal_to<>; };
+
+// The operand of a comparison is a column if it is a terminal containing a
+// std::vector, and a scalar if it is a terminal containing an arithmetic
+// value.  std::vector<bool> is left to refine_leaf_by_row(), since its
+// elements cannot be referred to.
+template <typename Expr, bool IsTerminal =
+              std::decay_t<Expr>::kind == boost::yap::expr_kind::terminal>
+struct leaf_operand { using type = void; };
+
+template <typename Expr>
+struct leaf_operand<Expr, true>
+{
+    using type = std::decay_t<
+        decltype(std::declval<Expr>().elements[boost::hana::llong_c<0>])>;
+};
+
+template <typename T>
+struct is_column_operand : std::false_type {};
+template <typename T, typename A>
+struct is_column_operand<std::vector<T, A>> : std::true_type {};
+template <typename A>
+struct is_column_operand<std::vector<bool, A>> : std::false_type {};
+
+template <typename T>
+struct is_scalar_operand : std::is_arithmetic<T> {};
+
+template <typename L, typename R,
+          typename LValue = typename leaf_operand<L>::type,
+          typename RValue = typename leaf_operand<R>::type>
+struct is_columnar_comparison :
+    std::integral_constant<
+        bool,
+        (is_column_operand<LValue>::value || is_column_operand<RValue>::value) &&
+        (is_column_operand<LValue>::value || is_scalar_operand<LValue>::value) &&
+        (is_column_operand<RValue>::value || is_scalar_operand<RValue>::value)
+    >
+{};
+
+// The kernel below works on a pointer to each column's values, and a copy of
+// each scalar.  Since these are locals, the compiler knows that writing the
+// results does not change them.
+template <typename T, typename A>
+T const * kernel_operand (std::vector<T, A> const & column)
+{ return column.data(); }
+
+template <typename T>
+T kernel_operand (T const & scalar)
+{ return scalar; }
+
+template <typename T>
+T const & operand_at (T const * values, std::size_t row)
+{ return values[row]; }
+
+template <typename T>
+T operand_at (T scalar, std::size_t)
+{ return scalar; }
+
+// The type two kernel operands are compared as.
+template <typename L, typename R>
+using comparison_value_t = std::common_type_t<
+    std::remove_const_t<std::remove_pointer_t<L>>,
+    std::remove_const_t<std::remove_pointer_t<R>>>;
+
+// Whether comparing values of the given size over a contiguous range of rows
+// into a byte per row, as the kernel below does, is faster than evaluating
+// the rows one by one.  That depends on the compiler vectorizing the loop,
+// which GCC does at -O3 but not at -O2, where it never pays off.  At -O3 with
+// only the SSE2 of baseline x86-64, narrowing 8-byte comparison results to
+// bytes costs more than the comparisons save, and comparing doubles this way
+// was measured about 30% slower than one row at a time, while 4-byte values
+// were about 20% faster.  With AVX2, both are faster.
+constexpr bool vectorized_comparison_pays (std::size_t value_size)
+{
+#if defined(__AVX2__)
+    return true;
+#else
+    return value_size <= 4;
+#endif
+}
+
+// For each combination of 8 pass/fail results, the positions of the ones
+// that passed, and how many there are.
+struct compaction_table
+{
+    std::uint8_t positions[256][8];
+    std::uint8_t count[256];
+};
+
+constexpr compaction_table make_compaction_table ()
+{
+    compaction_table retval{};
+    for (unsigned mask = 0; mask < 256; ++mask) {
+        std::uint8_t n = 0;
+        for (std::uint8_t bit = 0; bit < 8; ++bit) {
+            if (mask & (1u << bit))
+                retval.positions[mask][n++] = bit;
+        }
+        retval.count[mask] = n;
+    }
+    return retval;
+}
+
+// Evaluates a comparison between columns and scalars for a whole selection
+// in one loop, and compacts the result.  When the selection is a contiguous
+// range of rows, as it is for the first predicate applied to a batch, and
+// vectorized_comparison_pays(), the comparison is a loop over contiguous
+// slices of the columns, written so that it can be vectorized.  Its results
+// are then compacted 8 rows at a time: the 8 results form an index into a
+// table giving the positions of the rows that passed, and all 8 positions
+// are written whether they passed or not.  Otherwise the column values are
+// read through the selection, and compacted the same way as in
+// refine_leaf_by_row().
+template <typename Op, typename L, typename R>
+std::size_t compare_columns (Op op, L lhs, R rhs,
+                             selection in, std::uint32_t * out)
+{
+    static constexpr compaction_table table = make_compaction_table();
+    constexpr bool vectorize =
+        vectorized_comparison_pays(sizeof(comparison_value_t<L, R>));
+
+    std::size_t n = 0;
+    if (vectorize && in.size &&
+        in.rows[in.size - 1] - in.rows[0] + 1 == in.size) {
+        std::uint32_t const first = in.rows[0];
+        std::uint8_t passed[batch_size];
+        for (std::size_t i = 0; i < in.size; ++i) {
+            passed[i] =
+                op(operand_at(lhs, first + i), operand_at(rhs, first + i));
+        }
+
+        // Writing all 8 positions is safe, even in place, since n never
+        // exceeds i.
+        std::size_t i = 0;
+        for (; i + 8 <= in.size; i += 8) {
+            std::uint64_t bytes = 0;
+            for (std::size_t j = 0; j < 8; ++j) {
+                bytes |= std::uint64_t(passed[i + j]) << (8 * j);
+            }
+            unsigned const mask = (bytes * 0x0102040810204080ull) >> 56;
+            std::uint32_t const row = static_cast<std::uint32_t>(first + i);
+            for (std::size_t j = 0; j < 8; ++j) {
+                out[n + j] = row + table.positions[mask][j];
+            }
+            n += table.count[mask];
+        }
+        for (; i < in.size; ++i) {
+            out[n] = static_cast<std::uint32_t>(first + i);
+            n += passed[i];
+        }
+    } else {
+        for (std::size_t i = 0; i < in.size; ++i) {
+            std::uint32_t const row = in.rows[i];
+            out[n] = row;
+            n += op(operand_at(lhs, row), operand_at(rhs, row));
+        }
+    }
+    return n;
+}
+
+template <boost::yap::expr_kind Kind, typename L, typename R,
+          typename Op = typename comparison_op<Kind>::type>
+auto refine_leaf (
+    boost::yap::expression<Kind, boost::hana::tuple<L, R>> const & predicate,
+    selection in, std::uint32_t * out
+) -> std::enable_if_t<is_columnar_comparison<L, R>::value, std::size_t>
+{
+    using boost::hana::llong_c;
+    return compare_columns(
+        Op{},
+        kernel_operand(predicate.elements[llong_c<0>].elements[llong_c<0>]),
+        kernel_operand(predicate.elements[llong_c<1>].elements[llong_c<0>]),
+        in, out);
+}
+
+// Narrows the selection in to the rows for which a predicate is true, and
+// writes them to out, which may be the same as in.rows.  Each conjunct of a
+// logical_and is only evaluated on the rows that survived the ones before it,
+// and the right side of a logical_or only on the rows that failed its left
+// side.  Any other expression is a leaf predicate, evaluated by
+// refine_leaf().
+struct refine_impl
+{
+    template <typename T, typename U>
+    std::size_t operator() (boost::yap::expr_tag<boost::yap::expr_kind::logical_and>,
+                            T && lhs, U && rhs)
+    {
+        std::size_t const n = refine(lhs, in, out);
+        return refine(rhs, selection{out, n}, out);
+    }
+
+    template <typename T, typename U>
+    std::size_t operator() (boost::yap::expr_tag<boost::yap::expr_kind::logical_or>,
+                            T && lhs, U && rhs)
+    {
+        selection lhs_passed{pool.acquire(), 0};
+        selection lhs_failed{pool.acquire(), 0};
+        lhs_passed.size = refine(lhs, in, lhs_passed.rows);
+        lhs_failed.size = difference(in, lhs_passed, lhs_failed.rows);
+        std::size_t const rhs_passed = refine(rhs, lhs_failed, lhs_failed.rows);
+        std::size_t const n = std::merge(
+            lhs_passed.rows, lhs_passed.rows + lhs_passed.size,
+            lhs_failed.rows, lhs_failed.rows + rhs_passed,
+            out) - out;
+        pool.release(2);
+        return n;
+    }
+
+    template <typename T>
+    std::size_t operator() (boost::yap::expr_tag<boost::yap::expr_kind::logical_not>,
+                            T && operand)
+    {
+        selection passed{pool.acquire(), 0};
+        passed.size = refine(operand, in, passed.rows);
+        std::size_t const n = difference(in, passed, out);
+        pool.release(1);
+        return n;
+    }
+
+    template <boost::yap::expr_kind Kind, typename Tuple>
+    std::size_t operator() (boost::yap::expression<Kind, Tuple> const & predicate)
+    { return refine_leaf(predicate, in, out); }
+
+    template <typename Expr>
+    std::size_t refine (Expr const & expr, selection in_, std::uint32_t * out_)
+    {
+        return boost::yap::transform(
+            boost::yap::as_expr(expr), refine_impl{pool, in_, out_});
+    }
+
+    scratch_pool & pool;
+    selection in;
+    std::uint32_t * out;
+};
+
+template <typename Expr>
+std::size_t row_count (Expr const & expr)
+{
+    extent_impl extent{0, false, true};
+    boost::yap::transform(expr, extent);
+    assert(extent.seen_column && extent.equal_sizes);
+    return extent.size;
+}
+
+// Calls refine(batch), which must narrow the selection batch in place and
+// return its new size, for each batch of the given number of rows.  The
+// surviving rows of each are appended to out_indices.
+template <typename Refine>
+void for_each_batch (std::size_t rows,
+                     std::vector<std::uint32_t> & out_indices,
+                     Refine && refine)
+{
+    std::vector<std::uint32_t> batch(batch_size);
+    for (std::size_t first = 0; first < rows; first += batch_size) {
+        std::size_t const size = (std::min)(batch_size, rows - first);
+        for (std::size_t i = 0; i < size; ++i) {
+            batch[i] = static_cast<std::uint32_t>(first + i);
+        }
+        std::size_t const n = refine(selection{batch.data(), size});
+        out_indices.insert(out_indices.end(), batch.begin(), batch.begin() + n);
+    }
+}
+
+// Appends to out_indices the indices of the rows of the column expression
+// expr for which it is true.  expr may be any tree of logical_and,
+// logical_or, and logical_not, whose leaves are predicates over the columns.
+template <typename Expr>
+void select (Expr const & e, std::vector<std::uint32_t> & out_indices)
+{
+    decltype(auto) expr = boost::yap::as_expr(e);
+    scratch_pool pool{{}, 0};
+    for_each_batch(row_count(expr), out_indices, [&](selection batch) {
+        return boost::yap::transform(
+            expr, refine_impl{pool, batch, batch.rows});
+    });
+}
+
+
+//[ columnar_select_adaptive
+// select() always evaluates the operands of a logical_and or logical_or in
+// the order they were written.  The best order depends on how selective and
+// how expensive each one is, which is generally only known at run time.  An
+// adaptive_filter instead keeps statistics for each operand of each
+// junction, and periodically reorders them.
+//
+// Short-circuit semantics are preserved.  Only operands that are known to be
+// free of side effects, and safe to evaluate on any row, are reordered, and
+// only among themselves.  Any other operand stays where it was written, so
+// that it still sees exactly the rows that the operands written before it
+// did not decide.  In a guard like "col_d != 0 && col_a / col_d > 2", the
+// division is never moved ahead of the test that protects it.
+
+// Statistics are only gathered for every sample_period-th batch, and the
+// operands are reordered after every reorder_period batches.
+constexpr std::size_t sample_period = 4;
+constexpr std::size_t reorder_period = 16;
+
+// Whether a node of the given kind can be evaluated on any row, in any
+// order: it has no side effects, and does not fail for some values, as
+// division by zero, an oversized shift, or an out-of-range subscript can.
+// Calls are assumed to be unsafe, since nothing is known about the callable.
+constexpr bool kind_is_reorderable (boost::yap::expr_kind kind)
+{
+    switch (kind) {
+    case boost::yap::expr_kind::dereference:
+    case boost::yap::expr_kind::pre_inc:
+    case boost::yap::expr_kind::pre_dec:
+    case boost::yap::expr_kind::post_inc:
+    case boost::yap::expr_kind::post_dec:
+    case boost::yap::expr_kind::shift_left:
+    case boost::yap::expr_kind::shift_right:
+    case boost::yap::expr_kind::divides:
+    case boost::yap::expr_kind::modulus:
+    case boost::yap::expr_kind::assign:
+    case boost::yap::expr_kind::shift_left_assign:
+    case boost::yap::expr_kind::shift_right_assign:
+    case boost::yap::expr_kind::multiplies_assign:
+    case boost::yap::expr_kind::divides_assign:
+    case boost::yap::expr_kind::modulus_assign:
+    case boost::yap::expr_kind::plus_assign:
+    case boost::yap::expr_kind::minus_assign:
+    case boost::yap::expr_kind::bitwise_and_assign:
+    case boost::yap::expr_kind::bitwise_or_assign:
+    case boost::yap::expr_kind::bitwise_xor_assign:
+    case boost::yap::expr_kind::subscript:
+    case boost::yap::expr_kind::call: return false;
+    default: return true;
+    }
+}
+
+constexpr bool all_reorderable ()
+{ return true; }
+
+template <typename... Bools>
+constexpr bool all_reorderable (bool reorderable, Bools... reorderables)
+{ return reorderable && all_reorderable(reorderables...); }
+
+// Whether the predicate Expr may be reordered relative to its neighbors.
+// Specialize this to mark predicates that are safe to reorder, but that this
+// cannot prove safe.
+template <typename Expr>
+struct is_reorderable;
+
+template <boost::yap::expr_kind Kind, typename... T>
+struct is_reorderable<boost::yap::expression<Kind, boost::hana::tuple<T...>>> :
+    std::integral_constant<
+        bool,
+        kind_is_reorderable(Kind) && all_reorderable(
+            is_reorderable<boost::yap::detail::remove_cv_ref_t<T>>::value...)
+    >
+{};
+
+template <typename T>
+struct is_reorderable<
+    boost::yap::expression<boost::yap::expr_kind::terminal, boost::hana::tuple<T>>
+> : std::true_type
+{};
+
+template <typename Expr>
+struct is_reorderable<
+    boost::yap::expression<boost::yap::expr_kind::expr_ref, boost::hana::tuple<Expr *>>
+> : is_reorderable<std::remove_const_t<Expr>>
+{};
+
+// Accumulated measurements for a single operand of a junction.
+struct operand_stats
+{
+    double rows_in;
+    double rows_passed;
+    double nanoseconds;
+};
+
+// A leaf predicate, evaluated with refine_leaf().
+template <typename Expr>
+struct leaf_node
+{
+    static constexpr bool reorderable = is_reorderable<Expr>::value;
+
+    std::size_t refine (scratch_pool &, selection in, std::uint32_t * out)
+    { return refine_leaf(expr, in, out); }
+
+    Expr expr;
+};
+
+template <typename Node>
+struct not_node
+{
+    static constexpr bool reorderable = Node::reorderable;
+
+    std::size_t refine (scratch_pool & pool, selection in, std::uint32_t * out)
+    {
+        selection passed{pool.acquire(), 0};
+        passed.size = operand.refine(pool, in, passed.rows);
+        std::size_t const n = difference(in, passed, out);
+        pool.release(1);
+        return n;
+    }
+
+    Node operand;
+};
+
+template <typename Operands>
+struct junction_operands;
+
+template <typename... Nodes>
+struct junction_operands<boost::hana::tuple<Nodes...>>
+{
+    static constexpr bool all_reorderable =
+        ::all_reorderable(Nodes::reorderable...);
+
+    static std::array<bool, sizeof...(Nodes)> reorderable ()
+    { return {{Nodes::reorderable...}}; }
+};
+
+// A flattened chain of logical_ands (when IsAnd is true) or of logical_ors,
+// whose operands are evaluated in the order given by order.
+template <bool IsAnd, typename Operands>
+struct junction_node
+{
+    static constexpr std::size_t size =
+        decltype(boost::hana::size(std::declval<Operands>()))::value;
+    static constexpr bool reorderable =
+        junction_operands<Operands>::all_reorderable;
+
+    using clock = std::chrono::steady_clock;
+    using refine_fn = std::size_t (*)(
+        junction_node &, scratch_pool &, selection, std::uint32_t *);
+
+    explicit junction_node (Operands operands_) :
+        operands (std::move(operands_)),
+        stats (),
+        batches (0)
+    {
+        // Each operand that cannot be reordered is in a segment of its own,
+        // between the segments of the operands written before and after it.
+        std::array<bool, size> const reorderable_operands =
+            junction_operands<Operands>::reorderable();
+        std::size_t current_segment = 0;
+        for (std::size_t i = 0; i < size; ++i) {
+            order[i] = i;
+            if (reorderable_operands[i]) {
+                segment[i] = current_segment;
+            } else {
+                segment[i] = ++current_segment;
+                ++current_segment;
+            }
+        }
+    }
+
+    std::size_t refine (scratch_pool & pool, selection in, std::uint32_t * out)
+    {
+        bool const sample = batches % sample_period == 0;
+        std::size_t const n = refine(
+            std::integral_constant<bool, IsAnd>{}, pool, in, out, sample);
+        if (++batches % reorder_period == 0)
+            reorder();
+        return n;
+    }
+
+    // Each operand narrows the rows that survived the ones before it.
+    std::size_t refine (std::true_type, scratch_pool & pool, selection in,
+                        std::uint32_t * out, bool sample)
+    {
+        selection current = in;
+        for (std::size_t i = 0; i < size && current.size; ++i) {
+            std::size_t const n =
+                refine_operand(order[i], pool, current, out, sample);
+            current = selection{out, n};
+        }
+        return current.size;
+    }
+
+    // Each operand only looks at the rows that all the ones before it
+    // rejected.  The result is whichever rows were not rejected by all of
+    // them.
+    std::size_t refine (std::false_type, scratch_pool & pool, selection in,
+                        std::uint32_t * out, bool sample)
+    {
+        selection rejected{pool.acquire(), in.size};
+        std::copy(in.rows, in.rows + in.size, rejected.rows);
+        selection passed{pool.acquire(), 0};
+        for (std::size_t i = 0; i < size && rejected.size; ++i) {
+            passed.size =
+                refine_operand(order[i], pool, rejected, passed.rows, sample);
+            rejected.size = difference(rejected, passed, rejected.rows);
+        }
+        std::size_t const n = difference(in, rejected, out);
+        pool.release(2);
+        return n;
+    }
+
+    std::size_t refine_operand (std::size_t i, scratch_pool & pool,
+                                selection in, std::uint32_t * out, bool sample)
+    {
+        if (!sample)
+            return refine_fns()[i](*this, pool, in, out);
+        clock::time_point const start = clock::now();
+        std::size_t const n = refine_fns()[i](*this, pool, in, out);
+        std::chrono::duration<double, std::nano> const elapsed =
+            clock::now() - start;
+        stats[i].rows_in += in.size;
+        stats[i].rows_passed += n;
+        stats[i].nanoseconds += elapsed.count();
+        return n;
+    }
+
+    // Sorts the operands within each segment by their expected cost per row
+    // decided.  For a logical_and, that is the cost per row divided by the
+    // fraction of rows it rejects; for a logical_or, divided by the fraction
+    // it passes.  An operand with no measurements yet gets a rank of 0, so
+    // that it is tried early and measured.  The statistics are then decayed,
+    // so that they follow changes in the data.
+    void reorder ()
+    {
+        std::array<double, size> rank;
+        for (std::size_t i = 0; i < size; ++i) {
+            operand_stats & s = stats[i];
+            if (s.rows_in == 0.0) {
+                rank[i] = 0.0;
+            } else {
+                double const cost = s.nanoseconds / s.rows_in;
+                double const pass_rate = s.rows_passed / s.rows_in;
+                double const decided = IsAnd ? 1.0 - pass_rate : pass_rate;
+                rank[i] = cost / (std::max)(decided, 1.0e-6);
+            }
+            s.rows_in /= 2.0;
+            s.rows_passed /= 2.0;
+            s.nanoseconds /= 2.0;
+        }
+        std::stable_sort(
+            order.begin(), order.end(), [&](std::size_t lhs, std::size_t rhs) {
+                if (segment[lhs] != segment[rhs])
+                    return segment[lhs] < segment[rhs];
+                return rank[lhs] < rank[rhs];
+            });
+    }
+
+    template <std::size_t I>
+    static std::size_t refine_nth (junction_node & node, scratch_pool & pool,
+                                   selection in, std::uint32_t * out)
+    { return node.operands[boost::hana::size_c<I>].refine(pool, in, out); }
+
+    template <std::size_t... I>
+    static std::array<refine_fn, size> make_refine_fns (std::index_sequence<I...>)
+    { return {{&refine_nth<I>...}}; }
+
+    // Operands have different types, so they are dispatched to by index
+    // through this table.
+    static std::array<refine_fn, size> const & refine_fns ()
+    {
+        static std::array<refine_fn, size> const fns =
+            make_refine_fns(std::make_index_sequence<size>());
+        return fns;
+    }
+
+    Operands operands;
+    std::array<operand_stats, size> stats;
+    std::array<std::size_t, size> order;
+    std::array<std::size_t, size> segment;
+    std::size_t batches;
+};
+
+template <bool IsAnd, typename Operands>
+junction_node<IsAnd, Operands> make_junction (Operands operands)
+{ return junction_node<IsAnd, Operands>(std::move(operands)); }
+
+// Flattens a chain of logical_ands (or logical_ors) into a tuple of the nodes
+// built from its operands by BuildNode.
+template <boost::yap::expr_kind JunctionKind, typename BuildNode>
+struct flatten_junction
+{
+    template <typename T, typename U>
+    auto operator() (boost::yap::expr_tag<JunctionKind>, T && lhs, U && rhs)
+    {
+        return boost::hana::concat(
+            boost::yap::transform(boost::yap::as_expr(lhs), *this),
+            boost::yap::transform(boost::yap::as_expr(rhs), *this));
+    }
+
+    template <boost::yap::expr_kind Kind, typename Tuple>
+    auto operator() (boost::yap::expression<Kind, Tuple> const & expr)
+    { return boost::hana::make_tuple(boost::yap::transform(expr, BuildNode{})); }
+};
+
+// Builds the tree of nodes that an adaptive_filter evaluates.  Each leaf
+// keeps a copy of its predicate expression.
+struct build_node
+{
+    template <typename T, typename U>
+    auto operator() (boost::yap::expr_tag<boost::yap::expr_kind::logical_and>,
+                     T && lhs, U && rhs)
+    {
+        flatten_junction<boost::yap::expr_kind::logical_and, build_node> flatten;
+        return make_junction<true>(boost::hana::concat(
+            boost::yap::transform(boost::yap::as_expr(lhs), flatten),
+            boost::yap::transform(boost::yap::as_expr(rhs), flatten)));
+    }
+
+    template <typename T, typename U>
+    auto operator() (boost::yap::expr_tag<boost::yap::expr_kind::logical_or>,
+                     T && lhs, U && rhs)
+    {
+        flatten_junction<boost::yap::expr_kind::logical_or, build_node> flatten;
+        return make_junction<false>(boost::hana::concat(
+            boost::yap::transform(boost::yap::as_expr(lhs), flatten),
+            boost::yap::transform(boost::yap::as_expr(rhs), flatten)));
+    }
+
+    template <typename T>
+    auto operator() (boost::yap::expr_tag<boost::yap::expr_kind::logical_not>,
+                     T && operand)
+    {
+        auto node = boost::yap::transform(boost::yap::as_expr(operand), *this);
+        return not_node<decltype(node)>{std::move(node)};
+    }
+
+    template <boost::yap::expr_kind Kind, typename Tuple>
+    auto operator() (boost::yap::expression<Kind, Tuple> const & expr)
+    { return leaf_node<boost::yap::expression<Kind, Tuple>>{expr}; }
+};
+
+// Evaluates the same filter over and over, possibly on changing column
+// contents, adapting its evaluation order as it goes.  The columns and any
+// lvalue subexpressions of the filter's expression must outlive it.
+template <typename Node>
+struct adaptive_filter
+{
+    // As select(), but using the current evaluation order.
+    void select (std::vector<std::uint32_t> & out_indices)
+    {
+        for_each_batch(rows, out_indices, [&](selection batch) {
+            return root.refine(pool, batch, batch.rows);
+        });
+    }
+
+    Node root;
+    std::size_t rows;
+    scratch_pool pool;
+};
+
+template <typename Expr>
+auto make_adaptive_filter (Expr const & e)
+{
+    decltype(auto) expr = boost::yap::as_expr(e);
+    auto root = boost::yap::transform(expr, build_node{});
+    return adaptive_filter<decltype(root)>{
+        std::move(root), row_count(expr), scratch_pool{{}, 0}};
+}
+//]
+
+
+// Define a type trait that identifies columns.
+template <typename T>
+struct is_column : std::false_type {};
+
+template <typename T, typename A>
+struct is_column<std::vector<T, A>> : std::true_type {};
+
+BOOST_YAP_USER_UDT_UNARY_OPERATOR(logical_not, boost::yap::expression, is_column); // !
+BOOST_YAP_USER_UDT_ANY_BINARY_OPERATOR(plus, boost::yap::expression, is_column); // +
+BOOST_YAP_USER_UDT_ANY_BINARY_OPERATOR(less, boost::yap::expression, is_column); // <
+BOOST_YAP_USER_UDT_ANY_BINARY_OPERATOR(less_equal, boost::yap::expression, is_column); // <=
+BOOST_YAP_USER_UDT_ANY_BINARY_OPERATOR(greater, boost::yap::expression, is_column); // >
+BOOST_YAP_USER_UDT_ANY_BINARY_OPERATOR(divides, boost::yap::expression, is_column); // /
+BOOST_YAP_USER_UDT_ANY_BINARY_OPERATOR(equal_to, boost::yap::expression, is_column); // ==
+BOOST_YAP_USER_UDT_ANY_BINARY_OPERATOR(not_equal_to, boost::yap::expression, is_column); // !=
+BOOST_YAP_USER_UDT_ANY_BINARY_OPERATOR(logical_or, boost::yap::expression, is_column); // ||
+BOOST_YAP_USER_UDT_ANY_BINARY_OPERATOR(logical_and, boost::yap::expression, is_column); // &&
+
+// Selects rows one at a time, for comparison.
+template <typename Pred>
+std::vector<std::uint32_t> select_rows (std::size_t rows, Pred pred)
+{
+    std::vector<std::uint32_t> retval;
+    for (std::size_t row = 0; row < rows; ++row) {
+        if (pred(row))
+            retval.push_back(static_cast<std::uint32_t>(row));
+    }
+    return retval;
+}
+
+// Since == on std::vectors builds an expression above, compare selections
+// this way.
+inline bool same_rows (std::vector<std::uint32_t> const & lhs,
+                       std::vector<std::uint32_t> const & rhs)
+{ return std::equal(lhs.begin(), lhs.end(), rhs.begin(), rhs.end()); }
+
+int main ()
+{
+    // A few batches' worth of rows, with a partial batch at the end.
+    std::size_t const rows = 3 * batch_size + 100;
+    std::vector<int> col_a(rows);
+    std::vector<double> col_b(rows);
+    std::vector<bool> col_c(rows);
+    std::vector<int> col_d(rows);
+    for (std::size_t i = 0; i < rows; ++i) {
+        col_a[i] = (i * 7) % 10;
+        col_b[i] = ((i * 13) % 100) / 10.0;
+        col_c[i] = i % 3 == 0;
+        col_d[i] = i % 5;
+    }
+
+    {
+        std::vector<std::uint32_t> selected;
+        select(col_a > 3 && col_b < 5.0, selected);
+        assert(same_rows(selected, select_rows(rows, [&](std::size_t i) {
+            return col_a[i] > 3 && col_b[i] < 5.0;
+        })));
+    }
+
+    {
+        std::vector<std::uint32_t> selected;
+        select((col_a == 1 || col_b > 8.0) && !col_c, selected);
+        assert(same_rows(selected, select_rows(rows, [&](std::size_t i) {
+            return (col_a[i] == 1 || col_b[i] > 8.0) && !col_c[i];
+        })));
+    }
+
+    {
+        // Leaves may be any predicate over the columns, not just
+        // comparisons.
+        std::vector<std::uint32_t> selected;
+        select(col_c || (col_a + col_b > 12.0 && !(col_a < 8)), selected);
+        assert(same_rows(selected, select_rows(rows, [&](std::size_t i) {
+            return col_c[i] || (col_a[i] + col_b[i] > 12.0 && !(col_a[i] < 8));
+        })));
+    }
+
+    {
+        // Comparisons of columns use a columnar kernel, both on whole
+        // batches and on sparse selections, and for values of every size.
+        // It selects the same rows as the row-by-row evaluation.
+        std::vector<std::uint32_t> dense(batch_size);
+        std::vector<std::uint32_t> sparse(batch_size / 3);
+        for (std::size_t i = 0; i < batch_size; ++i) {
+            dense[i] = static_cast<std::uint32_t>(batch_size + i);
+            if (i < sparse.size())
+                sparse[i] = static_cast<std::uint32_t>(3 * i + 1);
+        }
+        auto check_kernel = [&](auto const & predicate) {
+            for (std::vector<std::uint32_t> const & rows_in : {dense, sparse}) {
+                std::vector<std::uint32_t> kernel(rows_in);
+                std::vector<std::uint32_t> by_row(rows_in);
+                selection const in{kernel.data(), kernel.size()};
+                kernel.resize(refine_leaf(predicate, in, kernel.data()));
+                by_row.resize(refine_leaf_by_row(
+                    predicate, selection{by_row.data(), by_row.size()},
+                    by_row.data()));
+                assert(same_rows(kernel, by_row));
+                assert(!kernel.empty() && kernel.size() < rows_in.size());
+            }
+        };
+        check_kernel(boost::yap::as_expr(col_b <= col_a));
+        check_kernel(boost::yap::as_expr(col_d < col_a));
+    }
+
+    {
+        // The same filters, evaluated adaptively, select the same rows.
+        auto filter = make_adaptive_filter(
+            (col_a == 1 || col_b > 8.0 || col_c) && !(col_a < 2 && col_b < 3.0));
+        std::vector<std::uint32_t> selected;
+        filter.select(selected);
+        assert(same_rows(selected, select_rows(rows, [&](std::size_t i) {
+            return (col_a[i] == 1 || col_b[i] > 8.0 || col_c[i]) &&
+                   !(col_a[i] < 2 && col_b[i] < 3.0);
+        })));
+    }
+
+    {
+        // The first conjunct passes every row, and so decides nothing.  Once
+        // that has been measured, it is moved after the second, which
+        // rejects most rows.
+        auto filter = make_adaptive_filter(col_a < 10 && col_b < 1.0);
+        assert(filter.root.order[0] == 0);
+        std::vector<std::uint32_t> selected;
+        for (int i = 0; i < 8; ++i) {
+            selected.clear();
+            filter.select(selected);
+        }
+        assert(filter.root.order[0] == 1);
+        assert(same_rows(selected, select_rows(rows, [&](std::size_t i) {
+            return col_b[i] < 1.0;
+        })));
+    }
+
+    {
+        // The division may only be evaluated on rows where col_d is nonzero,
+        // so it is never reordered, and neither is anything moved past it.
+        // The first two conjuncts are still reordered between themselves.
+        auto filter = make_adaptive_filter(
+            col_a < 10 && col_d != 0 && col_a / col_d > 1 && col_b < 1.0);
+        std::vector<std::uint32_t> selected;
+        for (int i = 0; i < 8; ++i) {
+            selected.clear();
+            filter.select(selected);
+        }
+        assert(filter.root.order[0] == 1);
+        assert(filter.root.order[2] == 2 && filter.root.order[3] == 3);
+        assert(same_rows(selected, select_rows(rows, [&](std::size_t i) {
+            return col_d[i] != 0 && col_a[i] / col_d[i] > 1 && col_b[i] < 1.0;
+        })));
+    }
+
+    return 0;
+}
+//]
@@ -0,0 +1,213 @@
+// Copyright (C) 2016-2018 T. Zachary Laine
+//
+// Distributed under the Boost Software License, Version 1.0. (See
+// accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+//[ fused_assign
+#include <boost/yap/yap.hpp>
+
+#include <cassert>
+#include <vector>
+
+
+// Turns each std::vector terminal into a terminal containing its n-th
+// element.
+struct take_nth
+{
+    template <typename T>
+    auto operator() (boost::yap::expr_tag<boost::yap::expr_kind::terminal>,
+                     std::vector<T> const & vec)
+    { return boost::yap::make_terminal(vec[n]); }
+
+    std::size_t n;
+};
+
+template <typename Expr>
+decltype(auto) evaluate_nth (Expr const & expr, std::size_t n)
+{
+    return boost::yap::evaluate(
+        boost::yap::transform(boost::yap::as_expr(expr), take_nth{n}));
+}
+
+// A stateful transform that records the size of the first std::vector<>
+// terminal it sees, and whether all the others have the same size.
+struct extent_impl
+{
+    template <typename T>
+    auto operator() (boost::yap::expr_tag<boost::yap::expr_kind::terminal>,
+                     std::vector<T> const & vec)
+    {
+        if (!seen_vector) {
+            size = vec.size();
+            seen_vector = true;
+        } else if (vec.size() != size) {
+            equal_sizes = false;
+        }
+        return 0;
+    }
+
+    std::size_t size;
+    bool seen_vector;
+    bool equal_sizes;
+};
+
+template <typename Expr>
+extent_impl extent_of (Expr const & expr)
+{
+    extent_impl impl{0, false, true};
+    boost::yap::transform(boost::yap::as_expr(expr), impl);
+    return impl;
+}
+
+
+// Executes the n-th element of each of a comma-sequence of elementwise
+// assignment statements, in order.  Each statement's left-hand side must be
+// a std::vector terminal.
+struct execute_nth
+{
+    template <typename T, typename U>
+    auto operator() (boost::yap::expr_tag<boost::yap::expr_kind::comma>,
+                     T && lhs, U && rhs)
+    {
+        boost::yap::transform(boost::yap::as_expr(lhs), *this);
+        boost::yap::transform(boost::yap::as_expr(rhs), *this);
+        return 0;
+    }
+
+    template <typename T, typename Expr>
+    auto operator() (boost::yap::expr_tag<boost::yap::expr_kind::assign>,
+                     std::vector<T> & dest, Expr const & expr)
+    {
+        dest[n] = evaluate_nth(expr, n);
+        return 0;
+    }
+
+    template <typename T, typename Expr>
+    auto operator() (boost::yap::expr_tag<boost::yap::expr_kind::plus_assign>,
+                     std::vector<T> & dest, Expr const & expr)
+    {
+        dest[n] += evaluate_nth(expr, n);
+        return 0;
+    }
+
+    template <typename T, typename Expr>
+    auto operator() (boost::yap::expr_tag<boost::yap::expr_kind::minus_assign>,
+                     std::vector<T> & dest, Expr const & expr)
+    {
+        dest[n] -= evaluate_nth(expr, n);
+        return 0;
+    }
+
+    template <typename T, typename Expr>
+    auto operator() (boost::yap::expr_tag<boost::yap::expr_kind::multiplies_assign>,
+                     std::vector<T> & dest, Expr const & expr)
+    {
+        dest[n] *= evaluate_nth(expr, n);
+        return 0;
+    }
+
+    std::size_t n;
+};
+
+// Executes each statement of a comma-sequence in its own loop over that
+// statement's extent.
+struct execute_sequentially
+{
+    template <typename T, typename U>
+    auto operator() (boost::yap::expr_tag<boost::yap::expr_kind::comma>,
+                     T && lhs, U && rhs)
+    {
+        boost::yap::transform(boost::yap::as_expr(lhs), *this);
+        boost::yap::transform(boost::yap::as_expr(rhs), *this);
+        return 0;
+    }
+
+    template <boost::yap::expr_kind Kind, typename Tuple>
+    auto operator() (boost::yap::expression<Kind, Tuple> const & statement)
+    {
+        extent_impl const extent = extent_of(statement);
+        assert(extent.seen_vector && extent.equal_sizes);
+        for (std::size_t i = 0; i < extent.size; ++i) {
+            boost::yap::transform(statement, execute_nth{i});
+        }
+        return 0;
+    }
+};
+
+// Executes a comma-sequence of elementwise assignment statements.  When all
+// the std::vectors involved have the same size, all the statements are
+// executed together in a single loop, so that each element of each input is
+// loaded once while it is hot, rather than once per statement.  Since each
+// statement only reads element i of each std::vector while writing element i
+// of its destination, this produces the same results as executing the
+// statements one after another.  If the sizes differ, that is what happens.
+template <typename Expr>
+void fused_assign (Expr const & statements)
+{
+    extent_impl const extent = extent_of(statements);
+    if (extent.seen_vector && extent.equal_sizes) {
+        for (std::size_t i = 0; i < extent.size; ++i) {
+            boost::yap::transform(statements, execute_nth{i});
+        }
+    } else {
+        boost::yap::transform(statements, execute_sequentially{});
+    }
+}
+
+
+// Define a type trait that identifies std::vectors.
+template <typename T>
+struct is_vector : std::false_type {};
+
+template <typename T, typename A>
+struct is_vector<std::vector<T, A>> : std::true_type {};
+
+BOOST_YAP_USER_UDT_UNARY_OPERATOR(negate, boost::yap::expression, is_vector); // -
+BOOST_YAP_USER_UDT_ANY_BINARY_OPERATOR(multiplies, boost::yap::expression, is_vector); // *
+BOOST_YAP_USER_UDT_ANY_BINARY_OPERATOR(divides, boost::yap::expression, is_vector); // /
+BOOST_YAP_USER_UDT_ANY_BINARY_OPERATOR(plus, boost::yap::expression, is_vector); // +
+BOOST_YAP_USER_UDT_ANY_BINARY_OPERATOR(minus, boost::yap::expression, is_vector); // -
+
+int main ()
+{
+    double const dt = 0.5;
+
+    std::vector<double> position = {0.0, 1.0, 2.0, 3.0};
+    std::vector<double> velocity = {1.0, 1.0, 2.0, 2.0};
+    std::vector<double> const force = {2.0, 0.0, -2.0, 4.0};
+    std::vector<double> const mass = {1.0, 2.0, 2.0, 4.0};
+    std::vector<double> acceleration(4);
+    std::vector<double> energy(4);
+
+    // The destinations must be terminals, since operator=() cannot be
+    // defined as a non-member for std::vector.
+    auto a = boost::yap::make_terminal(acceleration);
+    auto v = boost::yap::make_terminal(velocity);
+    auto x = boost::yap::make_terminal(position);
+    auto e = boost::yap::make_terminal(energy);
+
+    // A time step: each statement reads what the previous ones wrote.
+    fused_assign((
+        a = force / mass,
+        v += a * dt,
+        x += v * dt,
+        e = 0.5 * mass * velocity * velocity
+    ));
+
+    assert(acceleration == std::vector<double>({2.0, 0.0, -1.0, 1.0}));
+    assert(velocity == std::vector<double>({2.0, 1.0, 1.5, 2.5}));
+    assert(position == std::vector<double>({1.0, 1.5, 2.75, 4.25}));
+    assert(energy == std::vector<double>({2.0, 1.0, 2.25, 12.5}));
+
+    // The statements have different extents, so they are not fused.
+    std::vector<int> small(2, 1);
+    std::vector<int> large(3, 2);
+    auto s = boost::yap::make_terminal(small);
+    auto l = boost::yap::make_terminal(large);
+    fused_assign((s *= 10, l -= large * 2));
+    assert(small == std::vector<int>({10, 10}));
+    assert(large == std::vector<int>({-2, -2, -2}));
+
+    return 0;
+}
+//]
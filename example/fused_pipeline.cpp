@@ -0,0 +1,791 @@
+// Copyright (C) 2016-2018 T. Zachary Laine
+//
+// Distributed under the Boost Software License, Version 1.0. (See
+// accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+//[ fused_pipeline
+#include <boost/yap/algorithm.hpp>
+
+#include <boost/hana/append.hpp>
+#include <boost/hana/size.hpp>
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <iterator>
+#include <mutex>
+#include <optional>
+#include <random>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#include <cassert>
+
+
+// The stages that may appear to the right of a pipe.  Streaming stages look
+// at each element once, in order, and produce at most one element for each
+// one they see.  Blocking stages need all their input before they can
+// produce any output.
+template<typename Pred>
+struct filter_stage
+{
+    Pred pred;
+};
+
+template<typename F>
+struct transform_stage
+{
+    F f;
+};
+
+struct take_stage
+{
+    std::size_t n;
+};
+
+// Removes adjacent duplicates, like std::unique(); on sorted input, this
+// removes all duplicates.
+struct unique_stage
+{};
+
+template<typename Compare>
+struct sort_stage
+{
+    Compare compare;
+};
+
+template<typename Pred>
+struct partition_stage
+{
+    Pred pred;
+};
+
+// Users never write these two stages; rewrite_pipeline (below) produces them
+// from "sort | take(k)" and "sort | unique", respectively.
+template<typename Compare>
+struct top_k_stage
+{
+    Compare compare;
+    std::size_t k;
+};
+
+template<typename Compare>
+struct sort_unique_stage
+{
+    Compare compare;
+};
+
+template<typename Stage>
+struct is_streaming : std::true_type
+{};
+template<typename Compare>
+struct is_streaming<sort_stage<Compare>> : std::false_type
+{};
+template<typename Pred>
+struct is_streaming<partition_stage<Pred>> : std::false_type
+{};
+template<typename Compare>
+struct is_streaming<top_k_stage<Compare>> : std::false_type
+{};
+template<typename Compare>
+struct is_streaming<sort_unique_stage<Compare>> : std::false_type
+{};
+
+// The type of the elements a stage produces when fed elements of type T.
+template<typename T, typename Stage>
+struct stage_output
+{
+    using type = T;
+};
+template<typename T, typename F>
+struct stage_output<T, transform_stage<F>>
+{
+    using type = std::decay_t<decltype(std::declval<F const &>()(
+        std::declval<T &>()))>;
+};
+
+
+//[ fused_pipeline_sinks
+// A streaming stage is evaluated by pushing elements into a sink, which does
+// its work and pushes its result into the sink downstream of it.  A sink
+// returns false once it wants no more input.  A whole run of adjacent
+// streaming stages thus becomes a single loop over the input, with no
+// intermediate range between the stages.
+template<typename T, typename Stage, typename Down>
+struct stage_sink;
+
+template<typename T, typename Pred, typename Down>
+struct stage_sink<T, filter_stage<Pred>, Down>
+{
+    template<typename U>
+    bool operator()(U && x)
+    {
+        return !stage_.pred(x) || down_(static_cast<U &&>(x));
+    }
+
+    filter_stage<Pred> const & stage_;
+    Down down_;
+};
+
+template<typename T, typename F, typename Down>
+struct stage_sink<T, transform_stage<F>, Down>
+{
+    template<typename U>
+    bool operator()(U && x)
+    {
+        return down_(stage_.f(x));
+    }
+
+    transform_stage<F> const & stage_;
+    Down down_;
+};
+
+template<typename T, typename Down>
+struct stage_sink<T, take_stage, Down>
+{
+    template<typename U>
+    bool operator()(U && x)
+    {
+        if (stage_.n <= taken_)
+            return false;
+        ++taken_;
+        return down_(static_cast<U &&>(x)) && taken_ < stage_.n;
+    }
+
+    take_stage const & stage_;
+    Down down_;
+    std::size_t taken_ = 0;
+};
+
+template<typename T, typename Down>
+struct stage_sink<T, unique_stage, Down>
+{
+    template<typename U>
+    bool operator()(U && x)
+    {
+        if (last_ && *last_ == x)
+            return true;
+        last_ = x;
+        return down_(static_cast<U &&>(x));
+    }
+
+    unique_stage const & stage_;
+    Down down_;
+    std::optional<T> last_;
+};
+
+// Appends whatever reaches the end of the run to a new buffer.
+template<typename T>
+struct append_sink
+{
+    template<typename U>
+    bool operator()(U && x)
+    {
+        out_.push_back(static_cast<U &&>(x));
+        return true;
+    }
+
+    std::vector<T> & out_;
+};
+
+// Since no streaming stage produces more than one element per element it
+// consumes, a run whose output type matches its input type can write its
+// results back into the buffer it is reading, at or before the position
+// being read.
+template<typename T>
+struct compact_sink
+{
+    template<typename U>
+    bool operator()(U && x)
+    {
+        if (&buf_[size_] != &x)
+            buf_[size_] = static_cast<U &&>(x);
+        ++size_;
+        return true;
+    }
+
+    std::vector<T> & buf_;
+    std::size_t & size_;
+};
+//]
+
+
+// Stages [I, J) of Stages, all of them streaming, fed elements of type T.
+template<typename T, typename Stages, std::size_t I, std::size_t J>
+struct run_output
+{
+    using stage_type = std::decay_t<decltype(
+        std::declval<Stages const &>()[boost::hana::size_c<I>])>;
+    using type = typename run_output<
+        typename stage_output<T, stage_type>::type,
+        Stages,
+        I + 1,
+        J>::type;
+};
+template<typename T, typename Stages, std::size_t J>
+struct run_output<T, Stages, J, J>
+{
+    using type = T;
+};
+
+template<typename Stages, std::size_t I>
+constexpr std::size_t streaming_run_end()
+{
+    constexpr std::size_t N =
+        decltype(boost::hana::size(std::declval<Stages>()))::value;
+    if constexpr (I == N) {
+        return I;
+    } else {
+        using stage_type = std::decay_t<decltype(
+            std::declval<Stages const &>()[boost::hana::size_c<I>])>;
+        if constexpr (is_streaming<stage_type>::value)
+            return streaming_run_end<Stages, I + 1>();
+        else
+            return I;
+    }
+}
+
+template<
+    typename T,
+    std::size_t I,
+    std::size_t J,
+    typename Stages,
+    typename Sink>
+auto make_sink(Stages const & stages, Sink sink)
+{
+    if constexpr (I == J) {
+        return sink;
+    } else {
+        auto const & stage = stages[boost::hana::size_c<I>];
+        using stage_type = std::decay_t<decltype(stage)>;
+        using output_type = typename stage_output<T, stage_type>::type;
+        auto down = make_sink<output_type, I + 1, J>(stages, sink);
+        return stage_sink<T, stage_type, decltype(down)>{stage, down};
+    }
+}
+
+
+//[ fused_pipeline_blocking
+// A fixed set of worker threads, which run submitted tasks in the order they
+// were submitted.
+class thread_pool
+{
+public:
+    explicit thread_pool(std::size_t threads)
+    {
+        for (std::size_t i = 0; i < threads; ++i) {
+            workers_.emplace_back([this] { work(); });
+        }
+    }
+
+    ~thread_pool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            done_ = true;
+        }
+        cv_.notify_all();
+        for (auto & worker : workers_) {
+            worker.join();
+        }
+    }
+
+    std::size_t size() const { return workers_.size(); }
+
+    template<typename F>
+    std::future<void> submit(F f)
+    {
+        std::packaged_task<void()> task(std::move(f));
+        auto retval = task.get_future();
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            tasks_.push_back(std::move(task));
+        }
+        cv_.notify_one();
+        return retval;
+    }
+
+private:
+    void work()
+    {
+        while (true) {
+            std::packaged_task<void()> task;
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                cv_.wait(lock, [this] { return done_ || !tasks_.empty(); });
+                if (tasks_.empty())
+                    return;
+                task = std::move(tasks_.front());
+                tasks_.pop_front();
+            }
+            task();
+        }
+    }
+
+    std::vector<std::thread> workers_;
+    std::deque<std::packaged_task<void()>> tasks_;
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    bool done_ = false;
+};
+
+// The pool shared by all pipelines, with one worker per hardware thread.
+thread_pool & default_thread_pool()
+{
+    static thread_pool pool(std::max(1u, std::thread::hardware_concurrency()));
+    return pool;
+}
+
+// Inputs at least this long are sorted on the thread pool.
+std::size_t const parallel_sort_threshold = 1 << 16;
+
+// A bottom-up merge sort: the given number of chunks are sorted as
+// concurrent tasks, then each round merges neighboring pairs of sorted runs,
+// also as concurrent tasks, back and forth between buf and a scratch buffer.
+// Only the calling thread waits on tasks, so the pool cannot deadlock.
+template<typename T, typename Compare>
+void parallel_merge_sort(
+    std::vector<T> & buf,
+    Compare const & compare,
+    thread_pool & pool,
+    std::size_t chunks)
+{
+    std::vector<std::size_t> bounds;
+    for (std::size_t i = 0; i <= chunks; ++i) {
+        bounds.push_back(buf.size() * i / chunks);
+    }
+
+    std::vector<std::future<void>> pending;
+    auto const wait = [&] {
+        for (auto & f : pending) {
+            f.get();
+        }
+        pending.clear();
+    };
+
+    for (std::size_t i = 0; i < chunks; ++i) {
+        pending.push_back(pool.submit([&, i] {
+            std::sort(
+                buf.begin() + bounds[i], buf.begin() + bounds[i + 1], compare);
+        }));
+    }
+    wait();
+
+    std::vector<T> scratch(buf.size());
+    std::vector<T> * from = &buf;
+    std::vector<T> * to = &scratch;
+    for (std::size_t width = 1; width < chunks; width *= 2) {
+        for (std::size_t i = 0; i < chunks; i += 2 * width) {
+            std::size_t const mid = std::min(i + width, chunks);
+            std::size_t const last = std::min(i + 2 * width, chunks);
+            pending.push_back(pool.submit([&, from, to, i, mid, last] {
+                std::merge(
+                    std::make_move_iterator(from->begin() + bounds[i]),
+                    std::make_move_iterator(from->begin() + bounds[mid]),
+                    std::make_move_iterator(from->begin() + bounds[mid]),
+                    std::make_move_iterator(from->begin() + bounds[last]),
+                    to->begin() + bounds[i],
+                    compare);
+            }));
+        }
+        wait();
+        std::swap(from, to);
+    }
+    if (from != &buf)
+        buf.swap(*from);
+}
+
+template<typename T, typename Compare>
+void sort_buffer(std::vector<T> & buf, Compare const & compare)
+{
+    thread_pool & pool = default_thread_pool();
+    if (parallel_sort_threshold <= buf.size() && 1u < pool.size())
+        parallel_merge_sort(buf, compare, pool, pool.size());
+    else
+        std::sort(buf.begin(), buf.end(), compare);
+}
+
+// Blocking stages always run in place, on a buffer that the pipeline owns.
+template<typename T, typename Compare>
+void run_blocking(sort_stage<Compare> const & stage, std::vector<T> & buf)
+{
+    sort_buffer(buf, stage.compare);
+}
+
+// Only the first k elements need to end up sorted.  For small k, keeping a
+// heap of k elements is cheapest; otherwise, partitioning around the k-th
+// element and sorting only what precedes it is.
+template<typename T, typename Compare>
+void run_blocking(top_k_stage<Compare> const & stage, std::vector<T> & buf)
+{
+    if (buf.size() <= stage.k) {
+        sort_buffer(buf, stage.compare);
+        return;
+    }
+    auto const kth = buf.begin() + stage.k;
+    if (stage.k <= buf.size() / 64) {
+        std::partial_sort(buf.begin(), kth, buf.end(), stage.compare);
+    } else {
+        std::nth_element(buf.begin(), kth, buf.end(), stage.compare);
+        std::sort(buf.begin(), kth, stage.compare);
+    }
+    buf.erase(kth, buf.end());
+}
+
+// After sorting, equivalent elements are adjacent, so a single compaction
+// removes them all.
+template<typename T, typename Compare>
+void run_blocking(
+    sort_unique_stage<Compare> const & stage, std::vector<T> & buf)
+{
+    sort_buffer(buf, stage.compare);
+    auto const equivalent = [&](T const & lhs, T const & rhs) {
+        return !stage.compare(lhs, rhs);
+    };
+    buf.erase(std::unique(buf.begin(), buf.end(), equivalent), buf.end());
+}
+
+template<typename T, typename Pred>
+void run_blocking(partition_stage<Pred> const & stage, std::vector<T> & buf)
+{
+    std::partition(buf.begin(), buf.end(), stage.pred);
+}
+//]
+
+
+// Runs stages [I, N) over buf, which the pipeline owns.
+template<std::size_t I, typename Stages, typename T>
+auto run_stages(Stages const & stages, std::vector<T> buf)
+{
+    constexpr std::size_t N =
+        decltype(boost::hana::size(std::declval<Stages>()))::value;
+    if constexpr (I == N) {
+        return buf;
+    } else if constexpr (!is_streaming<std::decay_t<decltype(
+                             stages[boost::hana::size_c<I>])>>::value) {
+        run_blocking(stages[boost::hana::size_c<I>], buf);
+        return run_stages<I + 1>(stages, std::move(buf));
+    } else {
+        constexpr std::size_t J = streaming_run_end<Stages, I>();
+        using output_type = typename run_output<T, Stages, I, J>::type;
+        if constexpr (std::is_same<output_type, T>::value) {
+            std::size_t size = 0;
+            auto sink =
+                make_sink<T, I, J>(stages, compact_sink<T>{buf, size});
+            for (std::size_t i = 0, n = buf.size(); i < n; ++i) {
+                if (!sink(std::move(buf[i])))
+                    break;
+            }
+            buf.resize(size);
+            return run_stages<J>(stages, std::move(buf));
+        } else {
+            std::vector<output_type> out;
+            out.reserve(buf.size());
+            auto sink = make_sink<T, I, J>(
+                stages, append_sink<output_type>{out});
+            for (auto & x : buf) {
+                if (!sink(std::move(x)))
+                    break;
+            }
+            return run_stages<J>(stages, std::move(out));
+        }
+    }
+}
+
+// Runs the whole pipeline.  Element 0 of stages points to the source range,
+// which is never modified.  The first buffer is either a copy of the source,
+// if the first stage is blocking, or the output of the first run of
+// streaming stages, read directly from the source.
+template<typename Stages>
+auto run_pipeline(Stages const & stages)
+{
+    auto const & source = *stages[boost::hana::size_c<0>];
+    using T = std::decay_t<decltype(*source.begin())>;
+    if constexpr (!is_streaming<std::decay_t<decltype(
+                      stages[boost::hana::size_c<1>])>>::value) {
+        return run_stages<1>(
+            stages, std::vector<T>(source.begin(), source.end()));
+    } else {
+        constexpr std::size_t J = streaming_run_end<Stages, 1>();
+        using output_type = typename run_output<T, Stages, 1, J>::type;
+        std::vector<output_type> out;
+        out.reserve(source.size());
+        auto sink =
+            make_sink<T, 1, J>(stages, append_sink<output_type>{out});
+        for (auto const & x : source) {
+            if (!sink(x))
+                break;
+        }
+        return run_stages<J>(stages, std::move(out));
+    }
+}
+
+
+//[ fused_pipeline_flatten
+// Flattens a pipe expression like "v | filter(p) | sort | take(3)", which
+// is a left-leaning tree of bitwise-or expressions, into a tuple containing
+// a pointer to v followed by the stages, in order.  Tag transforms see
+// terminals as their values, so the left side is turned back into an
+// expression with as_expr() before recursing into it.
+template<template<boost::yap::expr_kind, class> class ExprTemplate>
+struct flatten_pipeline
+{
+    template<typename Range>
+    auto operator()(boost::yap::expr_tag<boost::yap::expr_kind::terminal>,
+                    Range const & r)
+    {
+        return boost::hana::make_tuple(&r);
+    }
+
+    template<typename Left, typename Stage>
+    auto operator()(boost::yap::expr_tag<boost::yap::expr_kind::bitwise_or>,
+                    Left const & left,
+                    Stage const & stage)
+    {
+        return boost::hana::append(
+            boost::yap::transform(
+                boost::yap::as_expr<ExprTemplate>(left), *this),
+            stage);
+    }
+};
+//]
+
+template<typename Stage>
+struct is_sort_stage : std::false_type
+{};
+template<typename Compare>
+struct is_sort_stage<sort_stage<Compare>> : std::true_type
+{};
+
+//[ fused_pipeline_rewrite
+// Rewrites a pipe expression before it is run, innermost pipe first.  A
+// sort followed by take(k) becomes a single top-k stage, and a sort followed
+// by unique becomes a single sort-and-compact stage.  As in
+// flatten_pipeline, terminals are seen as their values.
+template<template<boost::yap::expr_kind, class> class ExprTemplate>
+struct rewrite_pipeline
+{
+    template<typename Range>
+    auto operator()(boost::yap::expr_tag<boost::yap::expr_kind::terminal>,
+                    Range const & r)
+    {
+        return boost::yap::make_terminal<ExprTemplate>(r);
+    }
+
+    template<typename Left, typename Stage>
+    auto operator()(boost::yap::expr_tag<boost::yap::expr_kind::bitwise_or>,
+                    Left const & left,
+                    Stage const & stage)
+    {
+        return pipe(
+            boost::yap::transform(
+                boost::yap::as_expr<ExprTemplate>(left), *this),
+            stage);
+    }
+
+    // Appends stage to the already-rewritten pipeline left, fusing it with
+    // the last stage of left if the two match one of the patterns.
+    template<typename Left, typename Stage>
+    static auto pipe(Left left, Stage const & stage)
+    {
+        using boost::yap::expr_kind;
+        if constexpr (Left::kind == expr_kind::bitwise_or) {
+            auto const & last = boost::yap::value(boost::yap::right(left));
+            using last_type = std::decay_t<decltype(last)>;
+            if constexpr (
+                is_sort_stage<last_type>::value &&
+                std::is_same<Stage, take_stage>::value) {
+                return boost::yap::make_expression<
+                    ExprTemplate,
+                    expr_kind::bitwise_or>(
+                    boost::yap::left(std::move(left)),
+                    top_k_stage<decltype(last.compare)>{last.compare,
+                                                        stage.n});
+            } else if constexpr (
+                is_sort_stage<last_type>::value &&
+                std::is_same<Stage, unique_stage>::value) {
+                return boost::yap::make_expression<
+                    ExprTemplate,
+                    expr_kind::bitwise_or>(
+                    boost::yap::left(std::move(left)),
+                    sort_unique_stage<decltype(last.compare)>{last.compare});
+            } else {
+                return boost::yap::make_expression<
+                    ExprTemplate,
+                    expr_kind::bitwise_or>(std::move(left), stage);
+            }
+        } else {
+            return boost::yap::make_expression<
+                ExprTemplate,
+                expr_kind::bitwise_or>(std::move(left), stage);
+        }
+    }
+};
+//]
+
+template<boost::yap::expr_kind Kind, typename Tuple>
+struct pipeline_expr
+{
+    static boost::yap::expr_kind const kind = Kind;
+
+    Tuple elements;
+
+    template<typename Assignee>
+    operator Assignee() const
+    {
+        auto result = run_pipeline(boost::yap::transform(
+            boost::yap::transform(*this, rewrite_pipeline<::pipeline_expr>{}),
+            flatten_pipeline<::pipeline_expr>{}));
+        if constexpr (std::is_same<Assignee, decltype(result)>::value) {
+            return result;
+        } else {
+            return Assignee(
+                std::make_move_iterator(result.begin()),
+                std::make_move_iterator(result.end()));
+        }
+    }
+};
+
+BOOST_YAP_USER_BINARY_OPERATOR(bitwise_or, pipeline_expr, pipeline_expr)
+
+template<typename Pred>
+auto filter(Pred pred)
+{
+    return boost::yap::make_terminal<pipeline_expr>(filter_stage<Pred>{pred});
+}
+
+template<typename F>
+auto transform(F f)
+{
+    return boost::yap::make_terminal<pipeline_expr>(transform_stage<F>{f});
+}
+
+auto take(std::size_t n)
+{
+    return boost::yap::make_terminal<pipeline_expr>(take_stage{n});
+}
+
+template<typename Pred>
+auto partition(Pred pred)
+{
+    return boost::yap::make_terminal<pipeline_expr>(
+        partition_stage<Pred>{pred});
+}
+
+// The stages that take no arguments are ready-made terminals.
+template<typename Stage>
+using stage_terminal =
+    pipeline_expr<boost::yap::expr_kind::terminal, boost::hana::tuple<Stage>>;
+
+stage_terminal<sort_stage<std::less<>>> const sort{};
+stage_terminal<unique_stage> const unique{};
+
+
+int main()
+{
+    {
+//[ fused_pipeline_usage
+        std::vector<int> const v = {9, 2, 2, 7, 1, 3, 8, 4, 4, 6};
+
+        // One pass filters, squares, and copies into the buffer to be
+        // sorted.  "sort | unique" is rewritten into a single sort followed
+        // by a compaction, and then one more pass stops after the third
+        // element.
+        std::vector<int> const top =
+            v | filter([](int i) { return i % 2 == 0; }) |
+            transform([](int i) { return i * i; }) | sort | unique | take(3);
+        assert(top == std::vector<int>({4, 16, 36}));
+//]
+
+        // v itself is never modified.
+        assert(v[0] == 9);
+    }
+
+    {
+        std::vector<int> const v = {5, 1, 4, 2, 3};
+        std::vector<std::string> const strings =
+            v | partition([](int i) { return i < 3; }) | take(2) |
+            transform([](int i) { return std::to_string(i); }) | sort;
+        assert(strings == std::vector<std::string>({"1", "2"}));
+
+        std::vector<long> const longs = v | sort;
+        assert(longs == std::vector<long>({1, 2, 3, 4, 5}));
+    }
+
+    {
+        // Large enough to take the parallel sort, on machines with several
+        // cores.
+        std::vector<int> v(parallel_sort_threshold * 4);
+        std::mt19937 gen;
+        std::uniform_int_distribution<int> dist(0, 1000);
+        for (auto & x : v) {
+            x = dist(gen);
+        }
+
+        std::vector<int> const result =
+            v | transform([](int i) { return i * 3; }) | sort | unique;
+
+        std::vector<int> expected = v;
+        for (auto & x : expected) {
+            x *= 3;
+        }
+        std::sort(expected.begin(), expected.end());
+        expected.erase(
+            std::unique(expected.begin(), expected.end()), expected.end());
+        assert(result == expected);
+
+        // Top-k, through both the partial_sort() and the nth_element()
+        // strategies.
+        for (std::size_t k : {std::size_t(10), v.size() / 2}) {
+            std::vector<int> const top_k =
+                v | transform([](int i) { return i * 3; }) | sort | take(k);
+            std::vector<int> expected_top_k = v;
+            for (auto & x : expected_top_k) {
+                x *= 3;
+            }
+            std::sort(expected_top_k.begin(), expected_top_k.end());
+            expected_top_k.resize(k);
+            assert(top_k == expected_top_k);
+        }
+
+        // So that the parallel sort is tested on any machine, use it on a
+        // pool of our own, with chunk counts that are and are not powers of
+        // two.
+        std::vector<int> expected_sorted = v;
+        std::sort(expected_sorted.begin(), expected_sorted.end());
+        thread_pool pool(3);
+        for (std::size_t chunks : {1, 2, 3, 4, 7}) {
+            std::vector<int> sorted = v;
+            parallel_merge_sort(sorted, std::less<>{}, pool, chunks);
+            assert(sorted == expected_sorted);
+        }
+    }
+
+    {
+        // The rewrites happen on the expression, before anything runs.
+        std::vector<int> const v = {3, 1, 2};
+        auto const stages = boost::yap::transform(
+            boost::yap::transform(
+                v | sort | take(2) | filter([](int i) { return i; }) | sort |
+                    unique,
+                rewrite_pipeline<pipeline_expr>{}),
+            flatten_pipeline<pipeline_expr>{});
+        using boost::hana::size_c;
+        static_assert(
+            std::is_same<
+                std::decay_t<decltype(stages[size_c<1>])>,
+                top_k_stage<std::less<>>>::value,
+            "");
+        static_assert(
+            std::is_same<
+                std::decay_t<decltype(stages[size_c<3>])>,
+                sort_unique_stage<std::less<>>>::value,
+            "");
+        static_assert(decltype(boost::hana::size(stages))::value == 4, "");
+    }
+}
+//]
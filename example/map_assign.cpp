@@ -6,14 +6,20 @@
 //[ map_assign
 #include <boost/yap/algorithm.hpp>
 
+#include <boost/container/flat_map.hpp>
+
+#include <algorithm>
+#include <array>
 #include <map>
+#include <unordered_map>
 #include <iostream>
 
 
 // This transform applies all the call-subexpressions in a map_list_of
 // expression (a nested chain of call operations) as a side effect; the
-// expression returned by the transform is ignored.
-template <typename Key, typename Value, typename Allocator>
+// expression returned by the transform is ignored.  Map may be any map type
+// with an emplace(key, value) member.
+template <typename Map>
 struct map_list_of_transform
 {
     template <typename Fn, typename Key2, typename Value2>
@@ -36,13 +42,50 @@ struct map_list_of_transform
         return 0;
     }
 
-    std::map<Key, Value, Allocator> & map;
+    Map & map;
+};
+
+// Like map_list_of_transform, except that the key/value pairs are copied into
+// an array, in the order they appear in the expression.
+template <typename Key, typename Value, std::size_t N>
+struct map_list_of_array_transform
+{
+    template <typename Fn, typename Key2, typename Value2>
+    auto operator() (boost::yap::expr_tag<boost::yap::expr_kind::call>,
+                     Fn const & fn, Key2 && key, Value2 && value)
+    {
+        boost::yap::transform(
+            boost::yap::as_expr<boost::yap::minimal_expr>(fn), *this);
+        entries[size].first = std::forward<Key2 &&>(key);
+        entries[size].second = std::forward<Value2 &&>(value);
+        ++size;
+        return 0;
+    }
+
+    std::array<std::pair<Key, Value>, N> & entries;
+    std::size_t size;
 };
 
 
+// The number of entries in a map_list_of expression is the number of call
+// expressions in its chain, so it is known from the expression's type alone.
+template <typename Expr, bool IsCall = Expr::kind == boost::yap::expr_kind::call>
+struct map_list_of_size : std::integral_constant<std::size_t, 0> {};
+
+template <typename Expr>
+struct map_list_of_size<Expr, true> :
+    std::integral_constant<
+        std::size_t,
+        1 + map_list_of_size<
+            std::decay_t<decltype(std::declval<Expr>().elements[boost::hana::llong_c<0>])>
+        >::value
+    >
+{};
+
+
 // A custom expression template type for map_list_of expressions.  We only
-// need support for the call operator and an implicit conversion to a
-// std::map.
+// need support for the call operator and implicit conversions to the map
+// types we want to initialize.
 template <boost::yap::expr_kind Kind, typename Tuple>
 struct map_list_of_expr
 {
@@ -54,8 +97,56 @@ struct map_list_of_expr
     operator std::map<Key, Value, Allocator> () const
     {
         std::map<Key, Value, Allocator> retval;
-        map_list_of_transform<Key, Value, Allocator> transform{retval};
+        map_list_of_transform<std::map<Key, Value, Allocator>> transform{retval};
+        boost::yap::transform(*this, transform);
+        return retval;
+    }
+
+    // The bucket count is reserved once, up front, so the map never rehashes
+    // while being filled.
+    template <typename Key, typename Value, typename Hash, typename Equal,
+              typename Allocator>
+    operator std::unordered_map<Key, Value, Hash, Equal, Allocator> () const
+    {
+        using map_type = std::unordered_map<Key, Value, Hash, Equal, Allocator>;
+        map_type retval;
+        retval.reserve(map_list_of_size<map_list_of_expr>::value);
+        map_list_of_transform<map_type> transform{retval};
+        boost::yap::transform(*this, transform);
+        return retval;
+    }
+
+    // Inserting into a flat_map one element at a time would shift its
+    // elements on every insertion.  Instead, the entries are gathered into an
+    // array on the stack, sorted and deduplicated once, and inserted as a
+    // single ordered range into storage that was allocated once.
+    template <typename Key, typename Value, typename Compare, typename Allocator>
+    operator boost::container::flat_map<Key, Value, Compare, Allocator> () const
+    {
+        constexpr std::size_t N = map_list_of_size<map_list_of_expr>::value;
+        std::array<std::pair<Key, Value>, N> entries;
+        map_list_of_array_transform<Key, Value, N> transform{entries, 0};
         boost::yap::transform(*this, transform);
+
+        // A stable sort keeps the first of any duplicate keys first, and
+        // unique() keeps it, just as emplace() would.
+        Compare compare;
+        auto const less = [&](auto const & lhs, auto const & rhs) {
+            return compare(lhs.first, rhs.first);
+        };
+        std::stable_sort(entries.begin(), entries.end(), less);
+        auto const last = std::unique(
+            entries.begin(), entries.end(),
+            [&](auto const & lhs, auto const & rhs) { return !less(lhs, rhs); }
+        );
+
+        boost::container::flat_map<Key, Value, Compare, Allocator> retval;
+        retval.reserve(last - entries.begin());
+        retval.insert(
+            boost::container::ordered_unique_range,
+            std::make_move_iterator(entries.begin()),
+            std::make_move_iterator(last)
+        );
         return retval;
     }
 
@@ -88,6 +179,39 @@ int main()
     std::cout << "\"=\"  --> " << op["="] << std::endl;
     std::cout << "\"<>\" --> " << op["<>"] << std::endl;
 
+    // The same expression initializes flat and unordered maps.  As with
+    // std::map, the first of any duplicate keys wins.
+    boost::container::flat_map<std::string, int> flat_op =
+        map_list_of
+            ("<", 1)
+            ("<=",2)
+            (">", 3)
+            (">=",4)
+            ("=", 5)
+            ("<>",6)
+            ("<", 7)
+        ;
+
+    std::unordered_map<std::string, int> unordered_op =
+        map_list_of
+            ("<", 1)
+            ("<=",2)
+            (">", 3)
+            (">=",4)
+            ("=", 5)
+            ("<>",6)
+            ("<", 7)
+        ;
+
+    if (flat_op.size() != op.size() || unordered_op.size() != op.size())
+        return 1;
+    for (auto const & pair : op) {
+        if (flat_op[pair.first] != pair.second ||
+            unordered_op[pair.first] != pair.second) {
+            return 1;
+        }
+    }
+
     return 0;
 }
 //]
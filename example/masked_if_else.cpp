@@ -0,0 +1,319 @@
+// Copyright (C) 2016-2018 T. Zachary Laine
+//
+// Distributed under the Boost Software License, Version 1.0. (See
+// accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+//[ masked_if_else
+#include <boost/yap/yap.hpp>
+
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+
+// The cost of evaluating a single node of the given kind, not counting its
+// operands.  Division is an order of magnitude slower than the other
+// arithmetic operations.
+constexpr int kind_cost (boost::yap::expr_kind kind)
+{
+    switch (kind) {
+    case boost::yap::expr_kind::terminal:
+    case boost::yap::expr_kind::expr_ref: return 0;
+    case boost::yap::expr_kind::divides:
+    case boost::yap::expr_kind::modulus: return 16;
+    default: return 1;
+    }
+}
+
+// Whether evaluating a node of the given kind is free of side effects.
+// Calls are assumed to have side effects, since nothing is known about the
+// callable.
+constexpr bool kind_is_pure (boost::yap::expr_kind kind)
+{
+    switch (kind) {
+    case boost::yap::expr_kind::pre_inc:
+    case boost::yap::expr_kind::pre_dec:
+    case boost::yap::expr_kind::post_inc:
+    case boost::yap::expr_kind::post_dec:
+    case boost::yap::expr_kind::assign:
+    case boost::yap::expr_kind::shift_left_assign:
+    case boost::yap::expr_kind::shift_right_assign:
+    case boost::yap::expr_kind::multiplies_assign:
+    case boost::yap::expr_kind::divides_assign:
+    case boost::yap::expr_kind::modulus_assign:
+    case boost::yap::expr_kind::plus_assign:
+    case boost::yap::expr_kind::minus_assign:
+    case boost::yap::expr_kind::bitwise_and_assign:
+    case boost::yap::expr_kind::bitwise_or_assign:
+    case boost::yap::expr_kind::bitwise_xor_assign:
+    case boost::yap::expr_kind::call: return false;
+    default: return true;
+    }
+}
+
+constexpr int sum_costs ()
+{ return 0; }
+
+template <typename... Ints>
+constexpr int sum_costs (int cost, Ints... costs)
+{ return cost + sum_costs(costs...); }
+
+constexpr bool all_pure ()
+{ return true; }
+
+template <typename... Bools>
+constexpr bool all_pure (bool pure, Bools... pures)
+{ return pure && all_pure(pures...); }
+
+// The cost trait: the total cost of evaluating one element of Expr, and
+// whether doing so is side-effect-free.  Specialize this for terminals whose
+// evaluation is not trivial.
+template <typename Expr>
+struct elementwise_cost;
+
+template <boost::yap::expr_kind Kind, typename... T>
+struct elementwise_cost<boost::yap::expression<Kind, boost::hana::tuple<T...>>>
+{
+    static constexpr int value = kind_cost(Kind) + sum_costs(
+        elementwise_cost<boost::yap::detail::remove_cv_ref_t<T>>::value...);
+    static constexpr bool pure = kind_is_pure(Kind) && all_pure(
+        elementwise_cost<boost::yap::detail::remove_cv_ref_t<T>>::pure...);
+};
+
+template <typename T>
+struct elementwise_cost<
+    boost::yap::expression<boost::yap::expr_kind::terminal, boost::hana::tuple<T>>
+>
+{
+    static constexpr int value = 0;
+    static constexpr bool pure = true;
+};
+
+template <typename Expr>
+struct elementwise_cost<
+    boost::yap::expression<boost::yap::expr_kind::expr_ref, boost::hana::tuple<Expr *>>
+> : elementwise_cost<std::remove_const_t<Expr>>
+{};
+
+// Both arms of an if_else are evaluated and blended when their combined cost
+// is at most this much, and neither has side effects.
+constexpr int max_blend_cost = 8;
+
+template <typename Then, typename Else>
+constexpr bool should_blend ()
+{
+    using then_cost = elementwise_cost<boost::yap::detail::remove_cv_ref_t<Then>>;
+    using else_cost = elementwise_cost<boost::yap::detail::remove_cv_ref_t<Else>>;
+    return then_cost::pure && else_cost::pure &&
+           then_cost::value + else_cost::value <= max_blend_cost;
+}
+
+
+// Selects then_ if cond is true and else_ otherwise, without a branch.
+// Integers and floating point values are blended with a mask made from cond;
+// anything else is selected with ?: on the already-evaluated values.
+template <typename T>
+std::enable_if_t<std::is_integral<T>::value && !std::is_same<T, bool>::value, T>
+blend (bool cond, T then_, T else_)
+{
+    using uint_t = std::make_unsigned_t<T>;
+    uint_t const mask = uint_t(0) - uint_t(cond);
+    return T((uint_t(then_) & mask) | (uint_t(else_) & ~mask));
+}
+
+template <typename T>
+std::enable_if_t<std::is_floating_point<T>::value, T>
+blend (bool cond, T then_, T else_)
+{
+    using uint_t = std::conditional_t<sizeof(T) == 8, std::uint64_t, std::uint32_t>;
+    static_assert(sizeof(T) == sizeof(uint_t), "Unsupported floating point type.");
+    uint_t then_bits, else_bits;
+    std::memcpy(&then_bits, &then_, sizeof(T));
+    std::memcpy(&else_bits, &else_, sizeof(T));
+    uint_t const mask = uint_t(0) - uint_t(cond);
+    uint_t const bits = (then_bits & mask) | (else_bits & ~mask);
+    T retval;
+    std::memcpy(&retval, &bits, sizeof(T));
+    return retval;
+}
+
+template <typename T>
+std::enable_if_t<!std::is_arithmetic<T>::value || std::is_same<T, bool>::value, T>
+blend (bool cond, T then_, T else_)
+{ return cond ? then_ : else_; }
+
+struct blend_fn
+{
+    template <typename T, typename U>
+    auto operator() (bool cond, T then_, U else_) const
+    {
+        using result_type = std::common_type_t<T, U>;
+        return blend<result_type>(cond, then_, else_);
+    }
+};
+
+
+// Rewrites each if_else whose arms are cheap and side-effect-free into a call
+// to blend_fn.  Since a call evaluates all its arguments, both arms are then
+// always evaluated.  Other if_elses are left as they are, and so are
+// evaluated with ?:, but their operands are still rewritten.
+struct masked_if_else
+{
+    template <typename Tuple>
+    auto operator() (
+        boost::yap::expression<boost::yap::expr_kind::if_else, Tuple> const & expr)
+    {
+        auto cond = boost::yap::transform(boost::yap::cond(expr), *this);
+        auto then_ = boost::yap::transform(boost::yap::then(expr), *this);
+        auto else_ = boost::yap::transform(boost::yap::else_(expr), *this);
+        using then_type = decltype(boost::yap::then(expr));
+        using else_type = decltype(boost::yap::else_(expr));
+        return rewrite(
+            std::integral_constant<bool, should_blend<then_type, else_type>()>{},
+            std::move(cond), std::move(then_), std::move(else_));
+    }
+
+    template <typename Cond, typename Then, typename Else>
+    auto rewrite (std::true_type, Cond && cond, Then && then_, Else && else_)
+    {
+        return boost::yap::make_expression<
+            boost::yap::expression,
+            boost::yap::expr_kind::call
+        >(
+            boost::yap::make_terminal(blend_fn{}),
+            std::move(cond), std::move(then_), std::move(else_)
+        );
+    }
+
+    template <typename Cond, typename Then, typename Else>
+    auto rewrite (std::false_type, Cond && cond, Then && then_, Else && else_)
+    {
+        return boost::yap::make_expression<
+            boost::yap::expression,
+            boost::yap::expr_kind::if_else
+        >(std::move(cond), std::move(then_), std::move(else_));
+    }
+};
+
+
+// Turns each std::vector terminal into a terminal containing its n-th
+// element.
+struct take_nth
+{
+    template <typename T>
+    auto operator() (boost::yap::expr_tag<boost::yap::expr_kind::terminal>,
+                     std::vector<T> const & vec)
+    { return boost::yap::make_terminal(vec[n]); }
+
+    std::size_t n;
+};
+
+// Assigns some expression e to the given vector by evaluating e elementwise,
+// after rewriting its cheap if_elses into branchless blends.
+template <typename T, typename Expr>
+std::vector<T> & assign (std::vector<T> & vec, Expr const & e)
+{
+    auto const expr = boost::yap::transform(boost::yap::as_expr(e), masked_if_else{});
+    for (std::size_t i = 0, size = vec.size(); i < size; ++i) {
+        vec[i] = boost::yap::evaluate(boost::yap::transform(expr, take_nth{i}));
+    }
+    return vec;
+}
+
+// As assign() above, just using +=.
+template <typename T, typename Expr>
+std::vector<T> & plus_assign (std::vector<T> & vec, Expr const & e)
+{
+    auto const expr = boost::yap::transform(boost::yap::as_expr(e), masked_if_else{});
+    for (std::size_t i = 0, size = vec.size(); i < size; ++i) {
+        vec[i] += boost::yap::evaluate(boost::yap::transform(expr, take_nth{i}));
+    }
+    return vec;
+}
+
+// operator+=() comes in two overloads.  The second takes an expression, and
+// is needed because it is a better match than the expression-building
+// operator+=() that YAP provides for expression right-hand sides.
+template <typename T, typename U>
+std::vector<T> & operator+= (std::vector<T> & vec, U const & u)
+{ return plus_assign(vec, u); }
+
+template <typename T, boost::yap::expr_kind Kind, typename Tuple>
+std::vector<T> & operator+= (std::vector<T> & vec,
+                             boost::yap::expression<Kind, Tuple> && expr)
+{ return plus_assign(vec, expr); }
+
+
+// Define a type trait that identifies std::vectors.
+template <typename T>
+struct is_vector : std::false_type {};
+
+template <typename T, typename A>
+struct is_vector<std::vector<T, A>> : std::true_type {};
+
+BOOST_YAP_USER_UDT_UNARY_OPERATOR(negate, boost::yap::expression, is_vector); // -
+BOOST_YAP_USER_UDT_ANY_BINARY_OPERATOR(multiplies, boost::yap::expression, is_vector); // *
+BOOST_YAP_USER_UDT_ANY_BINARY_OPERATOR(divides, boost::yap::expression, is_vector); // /
+BOOST_YAP_USER_UDT_ANY_BINARY_OPERATOR(plus, boost::yap::expression, is_vector); // +
+BOOST_YAP_USER_UDT_ANY_BINARY_OPERATOR(minus, boost::yap::expression, is_vector); // -
+BOOST_YAP_USER_UDT_ANY_BINARY_OPERATOR(less, boost::yap::expression, is_vector); // <
+BOOST_YAP_USER_UDT_ANY_BINARY_OPERATOR(greater, boost::yap::expression, is_vector); // >
+
+// A callable that counts how many times it is called.
+struct counted_negate
+{
+    double operator() (double x) const
+    {
+        ++*calls;
+        return -x;
+    }
+
+    int * calls;
+};
+
+int main ()
+{
+    std::vector<int> a = {0, 1, 2, 3, 4, 5};
+    std::vector<int> const b = {10, 20, 30, 40, 50, 60};
+    std::vector<int> const c = {-1, -2, -3, -4, -5, -6};
+    std::vector<int> const d = {40, 10, 50, 20, 60, 30};
+
+    // Both arms are terminals, so they are blended.
+    static_assert(
+        decltype(boost::yap::transform(
+            if_else(d < 30, b, c), masked_if_else{}))::kind ==
+            boost::yap::expr_kind::call,
+        "");
+    a += if_else(d < 30, b, c);
+    assert(a == std::vector<int>({-1, 21, -1, 43, -1, -1}));
+
+    std::vector<double> x = {1.0, -2.0, 3.0, -4.0};
+    std::vector<double> const y = {0.5, 0.5, 0.5, 0.5};
+    std::vector<double> result(4);
+
+    // Cheap arithmetic arms are blended too.
+    assign(result, if_else(x < 0.0, -x * y, x + y));
+    assert(result == std::vector<double>({1.5, 1.0, 3.5, 2.0}));
+
+    // Division is too expensive to evaluate speculatively, so this uses a
+    // branch.
+    static_assert(
+        decltype(boost::yap::transform(
+            if_else(x < 0.0, y / x, x), masked_if_else{}))::kind ==
+            boost::yap::expr_kind::if_else,
+        "");
+    assign(result, if_else(x < 0.0, y / x, x));
+    assert(result == std::vector<double>({1.0, -0.25, 3.0, -0.125}));
+
+    // A call may have side effects, so it is only evaluated for the elements
+    // that select it.
+    int calls = 0;
+    auto neg = boost::yap::make_terminal(counted_negate{&calls});
+    assign(result, if_else(x < 0.0, neg(x), x));
+    assert(result == std::vector<double>({1.0, 2.0, 3.0, 4.0}));
+    assert(calls == 2);
+
+    return 0;
+}
+//]
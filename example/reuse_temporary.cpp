@@ -0,0 +1,198 @@
+// Copyright (C) 2016-2018 T. Zachary Laine
+//
+// Distributed under the Boost Software License, Version 1.0. (See
+// accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+//[ reuse_temporary
+#include <boost/yap/yap.hpp>
+
+#include <boost/hana/for_each.hpp>
+
+#include <cassert>
+#include <vector>
+
+
+// Turns each std::vector terminal into a terminal containing its n-th
+// element.
+struct take_nth
+{
+    template <typename T>
+    auto operator() (boost::yap::expr_tag<boost::yap::expr_kind::terminal>,
+                     std::vector<T> const & vec)
+    { return boost::yap::make_terminal(vec[n]); }
+
+    std::size_t n;
+};
+
+// A stateful transform that records the size of the first std::vector<>
+// terminal it sees, and whether all the others have the same size.
+struct extent_impl
+{
+    template <typename T>
+    auto operator() (boost::yap::expr_tag<boost::yap::expr_kind::terminal>,
+                     std::vector<T> const & vec)
+    {
+        if (!seen_vector) {
+            size = vec.size();
+            seen_vector = true;
+        } else if (vec.size() != size) {
+            equal_sizes = false;
+        }
+        return 0;
+    }
+
+    std::size_t size;
+    bool seen_vector;
+    bool equal_sizes;
+};
+
+// Finds a std::vector<T> that the expression owns -- that is, one that was
+// moved into a terminal, not one referred to by a terminal -- with the given
+// size.  Expressions are walked directly rather than with
+// boost::yap::transform(), because transform() looks through expr_refs, and a
+// terminal reached through an expr_ref belongs to some other, still-live
+// expression.
+template <typename T>
+struct owned_buffer_finder
+{
+    // An owned std::vector<T>.
+    void operator() (
+        boost::yap::expression<
+            boost::yap::expr_kind::terminal,
+            boost::hana::tuple<std::vector<T>>
+        > & expr)
+    {
+        std::vector<T> & vec = boost::yap::value(expr);
+        if (!buffer && vec.size() == size)
+            buffer = &vec;
+    }
+
+    // Any other expression.  Its elements are searched in turn; terminals'
+    // values and expr_refs' pointers are caught by the overload below.
+    template <boost::yap::expr_kind Kind, typename Tuple>
+    void operator() (boost::yap::expression<Kind, Tuple> & expr)
+    {
+        boost::hana::for_each(expr.elements, [this](auto & element) {
+            (*this)(element);
+        });
+    }
+
+    // Anything else.
+    template <typename U>
+    void operator() (U &)
+    {}
+
+    std::size_t size;
+    std::vector<T> * buffer;
+};
+
+// Evaluates expr elementwise, and returns the result as a std::vector.  If
+// expr owns a std::vector of the right value type and size, its storage is
+// reused for the result; no allocation is made.  This is safe even though
+// the buffer is also read during evaluation, since evaluating element i only
+// reads element i of each std::vector, and does so before element i is
+// written.
+template <typename Expr>
+auto evaluate_into_temporary (Expr && expr)
+{
+    static_assert(
+        !std::is_lvalue_reference<Expr>::value,
+        "evaluate_into_temporary() may consume the buffers of expr, so expr "
+        "must be an rvalue.");
+
+    extent_impl extent{0, false, true};
+    boost::yap::transform(expr, extent);
+    assert(extent.seen_vector && extent.equal_sizes);
+    std::size_t const size = extent.size;
+
+    using value_type = std::decay_t<decltype(boost::yap::evaluate(
+        boost::yap::transform(expr, take_nth{0})))>;
+
+    owned_buffer_finder<value_type> finder{size, nullptr};
+    finder(expr);
+
+    if (finder.buffer) {
+        std::vector<value_type> & result = *finder.buffer;
+        for (std::size_t i = 0; i < size; ++i) {
+            result[i] =
+                boost::yap::evaluate(boost::yap::transform(expr, take_nth{i}));
+        }
+        return std::move(result);
+    }
+
+    std::vector<value_type> result;
+    result.reserve(size);
+    for (std::size_t i = 0; i < size; ++i) {
+        result.push_back(
+            boost::yap::evaluate(boost::yap::transform(expr, take_nth{i})));
+    }
+    return result;
+}
+
+
+// Define a type trait that identifies std::vectors.
+template <typename T>
+struct is_vector : std::false_type {};
+
+template <typename T, typename A>
+struct is_vector<std::vector<T, A>> : std::true_type {};
+
+// These let std::vectors appear on the left of an operator.  Operators with
+// an expression on the left are already provided by boost::yap::expression.
+BOOST_YAP_USER_UDT_UNARY_OPERATOR(negate, boost::yap::expression, is_vector); // -
+BOOST_YAP_USER_UDT_ANY_BINARY_OPERATOR(multiplies, boost::yap::expression, is_vector); // *
+BOOST_YAP_USER_UDT_ANY_BINARY_OPERATOR(divides, boost::yap::expression, is_vector); // /
+BOOST_YAP_USER_UDT_ANY_BINARY_OPERATOR(plus, boost::yap::expression, is_vector); // +
+BOOST_YAP_USER_UDT_ANY_BINARY_OPERATOR(minus, boost::yap::expression, is_vector); // -
+
+int main ()
+{
+    std::vector<double> const b = {1.0, 2.0, 3.0, 4.0};
+    std::vector<double> const c = {4.0, 3.0, 2.0, 1.0};
+
+    {
+        // The moved-in vector is dead after evaluation, so the result is
+        // written into its storage.
+        std::vector<double> tmp = {1.0, 1.0, 1.0, 1.0};
+        double const * const storage = tmp.data();
+        (void)storage;
+        std::vector<double> result = evaluate_into_temporary(
+            boost::yap::make_terminal(std::move(tmp)) * 2.0 + b);
+        assert(result == std::vector<double>({3.0, 4.0, 5.0, 6.0}));
+        assert(result.data() == storage);
+
+        // Chained intermediates keep reusing the same buffer.
+        result = evaluate_into_temporary(
+            c - boost::yap::make_terminal(std::move(result)) / 2.0);
+        assert(result == std::vector<double>({2.5, 1.0, -0.5, -2.0}));
+        assert(result.data() == storage);
+    }
+
+    {
+        // No owned vector, so a new one is allocated.
+        std::vector<double> result = evaluate_into_temporary(b + c);
+        assert(result == std::vector<double>(4, 5.0));
+        assert(result.data() != b.data() && result.data() != c.data());
+    }
+
+    {
+        // A terminal referred to through an expr_ref is still owned by the
+        // live expression t, and must not be reused.
+        auto t = boost::yap::make_terminal(std::vector<double>(4, 1.0));
+        std::vector<double> result = evaluate_into_temporary(t + b);
+        assert(result == std::vector<double>({2.0, 3.0, 4.0, 5.0}));
+        assert(boost::yap::value(t) == std::vector<double>(4, 1.0));
+    }
+
+    {
+        // The owned vector's value type does not match that of the result,
+        // so it cannot hold the result.
+        std::vector<int> ints = {1, 2, 3, 4};
+        std::vector<double> result = evaluate_into_temporary(
+            boost::yap::make_terminal(std::move(ints)) * 0.5);
+        assert(result == std::vector<double>({0.5, 1.0, 1.5, 2.0}));
+    }
+
+    return 0;
+}
+//]
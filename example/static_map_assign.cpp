@@ -0,0 +1,301 @@
+// Copyright (C) 2016-2018 T. Zachary Laine
+//
+// Distributed under the Boost Software License, Version 1.0. (See
+// accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+//[ static_map_assign
+#include <boost/yap/algorithm.hpp>
+
+#include <array>
+#include <cstdint>
+#include <stdexcept>
+#include <string_view>
+#include <type_traits>
+#include <iostream>
+
+
+// The same map_list_of expression template as in the Map Assign example,
+// minus the conversion to std::map.
+template <boost::yap::expr_kind Kind, typename Tuple>
+struct map_list_of_expr
+{
+    static boost::yap::expr_kind const kind = Kind;
+
+    Tuple elements;
+
+    BOOST_YAP_USER_CALL_OPERATOR_N(::map_list_of_expr, 2)
+};
+
+struct map_list_of_tag {};
+
+constexpr map_list_of_expr<
+    boost::yap::expr_kind::terminal,
+    boost::hana::tuple<map_list_of_tag>
+> map_list_of{};
+
+
+// The number of entries in a map_list_of expression is the number of call
+// expressions in its chain, which is known from its type alone.
+template <typename Expr, bool IsCall = Expr::kind == boost::yap::expr_kind::call>
+struct map_list_of_size : std::integral_constant<std::size_t, 0> {};
+
+template <typename Expr>
+struct map_list_of_size<Expr, true> :
+    std::integral_constant<
+        std::size_t,
+        1 + map_list_of_size<
+            std::decay_t<decltype(std::declval<Expr>().elements[boost::hana::llong_c<0>])>
+        >::value
+    >
+{};
+
+
+// Seeded hashes usable in constant expressions; FNV-1a for strings, and a
+// 64-bit finalizer mix for integral keys.
+constexpr std::uint64_t static_map_hash (std::string_view key, std::uint64_t seed)
+{
+    std::uint64_t retval = 0xcbf29ce484222325ull ^ seed;
+    for (char c : key) {
+        retval ^= static_cast<unsigned char>(c);
+        retval *= 0x100000001b3ull;
+    }
+    return retval;
+}
+
+template <typename Key, typename = std::enable_if_t<std::is_integral<Key>::value>>
+constexpr std::uint64_t static_map_hash (Key key, std::uint64_t seed)
+{
+    std::uint64_t retval = static_cast<std::uint64_t>(key) ^ seed;
+    retval ^= retval >> 33;
+    retval *= 0xff51afd7ed558ccdull;
+    retval ^= retval >> 33;
+    retval *= 0xc4ceb9fe1a85ec53ull;
+    retval ^= retval >> 33;
+    return retval;
+}
+
+
+template <typename Key, typename Value>
+struct static_map_entry
+{
+    Key key;
+    Value value;
+};
+
+// A fixed-size map whose perfect hash table is built when the map is
+// constructed, which for a constexpr map is at compile time.  Keys are first
+// hashed into one of M buckets.  A bucket holding a single key records that
+// key's slot directly; a bucket holding several records the seed of a second
+// hash that sends each of its keys to a distinct free slot.  A lookup is
+// therefore two hashes and one key comparison, with no probing and no heap.
+template <typename Key, typename Value, std::size_t N>
+class static_map
+{
+    // The table has the smallest power-of-two number of slots that can hold
+    // N entries.
+    static constexpr std::size_t table_size ()
+    {
+        std::size_t retval = 1;
+        while (retval < N)
+            retval *= 2;
+        return retval;
+    }
+
+    static constexpr std::size_t M = table_size();
+    static constexpr std::uint64_t bucket_seed = 0x9e3779b97f4a7c15ull;
+
+    static constexpr std::size_t bucket_of (Key key)
+    { return static_map_hash(key, bucket_seed) & (M - 1); }
+
+    static constexpr std::size_t slot_of (Key key, std::int64_t displacement)
+    {
+        if (displacement < 0)
+            return static_cast<std::size_t>(-displacement - 1);
+        return static_map_hash(key, static_cast<std::uint64_t>(displacement)) & (M - 1);
+    }
+
+public:
+    using entry_type = static_map_entry<Key, Value>;
+
+    explicit constexpr static_map (std::array<entry_type, N> const & entries) :
+        entries_ (entries),
+        displacements_ {},
+        slots_ {}
+    {
+        std::array<std::size_t, M> bucket_sizes {};
+        for (std::size_t i = 0; i < N; ++i) {
+            for (std::size_t j = 0; j < i; ++j) {
+                if (entries_[j].key == entries_[i].key)
+                    throw std::logic_error("Duplicate key in static_map.");
+            }
+            ++bucket_sizes[bucket_of(entries_[i].key)];
+        }
+
+        // Slot values are entry indices plus one; zero marks a free slot.
+        // The buckets with the most keys are placed first, while the table
+        // is emptiest.
+        for (std::size_t size = N; 2 <= size; --size) {
+            for (std::size_t b = 0; b < M; ++b) {
+                if (bucket_sizes[b] != size)
+                    continue;
+                std::array<std::size_t, N> bucket {};
+                std::size_t n = 0;
+                for (std::size_t i = 0; i < N; ++i) {
+                    if (bucket_of(entries_[i].key) == b)
+                        bucket[n++] = i;
+                }
+                std::int64_t displacement = 1;
+                while (!try_place(bucket, n, displacement))
+                    ++displacement;
+                displacements_[b] = displacement;
+            }
+        }
+
+        std::size_t free_slot = 0;
+        for (std::size_t i = 0; i < N; ++i) {
+            std::size_t const b = bucket_of(entries_[i].key);
+            if (bucket_sizes[b] != 1)
+                continue;
+            while (slots_[free_slot])
+                ++free_slot;
+            slots_[free_slot] = i + 1;
+            displacements_[b] = -static_cast<std::int64_t>(free_slot) - 1;
+        }
+    }
+
+    static constexpr std::size_t size () { return N; }
+
+    constexpr entry_type const * begin () const { return entries_.data(); }
+    constexpr entry_type const * end () const { return entries_.data() + N; }
+
+    // Returns a pointer to the value associated with key, or nullptr if there
+    // is none.
+    constexpr Value const * find (Key key) const
+    {
+        std::size_t const slot = slot_of(key, displacements_[bucket_of(key)]);
+        std::size_t const i = slots_[slot];
+        if (i == 0 || !(entries_[i - 1].key == key))
+            return nullptr;
+        return &entries_[i - 1].value;
+    }
+
+    constexpr bool contains (Key key) const
+    { return find(key) != nullptr; }
+
+    constexpr Value const & at (Key key) const
+    {
+        Value const * value = find(key);
+        if (!value)
+            throw std::out_of_range("Key not found in static_map.");
+        return *value;
+    }
+
+private:
+    constexpr bool try_place (
+        std::array<std::size_t, N> const & bucket,
+        std::size_t n,
+        std::int64_t displacement
+    ) {
+        for (std::size_t i = 0; i < n; ++i) {
+            std::size_t const slot = slot_of(entries_[bucket[i]].key, displacement);
+            if (slots_[slot]) {
+                for (std::size_t j = 0; j < i; ++j) {
+                    slots_[slot_of(entries_[bucket[j]].key, displacement)] = 0;
+                }
+                return false;
+            }
+            slots_[slot] = bucket[i] + 1;
+        }
+        return true;
+    }
+
+    std::array<entry_type, N> entries_;
+    std::array<std::int64_t, M> displacements_;
+    std::array<std::size_t, M> slots_;
+};
+
+
+// Like map_list_of_transform in the Map Assign example, this transform visits
+// the call-subexpressions from the innermost outward; here it copies each
+// key/value pair into a fixed-size array rather than into a std::map.
+template <typename Key, typename Value, std::size_t N>
+struct static_map_entries_transform
+{
+    template <typename Fn, typename Key2, typename Value2>
+    constexpr auto operator() (boost::yap::expr_tag<boost::yap::expr_kind::call>,
+                               Fn const & fn, Key2 && key, Value2 && value)
+    {
+        boost::yap::transform(
+            boost::yap::as_expr<boost::yap::minimal_expr>(fn), *this);
+        entries[size] = {Key(key), Value(value)};
+        ++size;
+        return 0;
+    }
+
+    std::array<static_map_entry<Key, Value>, N> entries;
+    std::size_t size;
+};
+
+// Converts a map_list_of expression to a static_map.  When the expression is
+// a constant expression -- all its keys and values are literals -- so is the
+// result.
+template <typename Key, typename Value, typename Expr>
+constexpr auto make_static_map (Expr const & expr)
+{
+    constexpr std::size_t N = map_list_of_size<Expr>::value;
+    static_map_entries_transform<Key, Value, N> transform{{}, 0};
+    boost::yap::transform(expr, transform);
+    return static_map<Key, Value, N>(transform.entries);
+}
+
+
+int main()
+{
+    using namespace std::literals;
+
+    // Initialize a map at compile time:
+    constexpr auto op = make_static_map<std::string_view, int>(
+        map_list_of
+            ("<", 1)
+            ("<=",2)
+            (">", 3)
+            (">=",4)
+            ("=", 5)
+            ("<>",6)
+    );
+
+    static_assert(op.size() == 6, "");
+    static_assert(op.at("<=") == 2, "");
+    static_assert(!op.contains("=="), "");
+
+    std::cout << "\"<\"  --> " << op.at("<") << std::endl;
+    std::cout << "\"<=\" --> " << op.at("<=") << std::endl;
+    std::cout << "\">\"  --> " << op.at(">") << std::endl;
+    std::cout << "\">=\" --> " << op.at(">=") << std::endl;
+    std::cout << "\"=\"  --> " << op.at("=") << std::endl;
+    std::cout << "\"<>\" --> " << op.at("<>") << std::endl;
+
+    // Integral keys work too.
+    constexpr auto opcode = make_static_map<int, std::string_view>(
+        map_list_of
+            (0x01, "nop"sv)
+            (0x10, "load"sv)
+            (0x11, "store"sv)
+            (0x20, "add"sv)
+            (0x21, "sub"sv)
+            (0x30, "jump"sv)
+            (0xff, "halt"sv)
+    );
+
+    static_assert(opcode.at(0x21) == "sub", "");
+
+    for (auto const & entry : opcode) {
+        if (opcode.find(entry.key) != &entry.value)
+            return 1;
+    }
+    if (opcode.find(0x02) || op.find("=<"))
+        return 1;
+
+    return 0;
+}
+//]
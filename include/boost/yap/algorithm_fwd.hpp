@@ -166,10 +166,10 @@ namespace boost { namespace yap {
         Expr && expr, Transform && transform, Transforms &&... transforms);
 
     template<typename T>
-    decltype(auto) deref(T && x);
+    constexpr decltype(auto) deref(T && x);
 
     template<typename Expr>
-    decltype(auto) value(Expr && expr);
+    constexpr decltype(auto) value(Expr && expr);
 
 #endif // BOOST_YAP_DOXYGEN
 
@@ -433,7 +433,7 @@ namespace boost { namespace yap { namespace detail {
     };
 
     template<typename T>
-    decltype(auto) terminal_value(T && x)
+    constexpr decltype(auto) terminal_value(T && x)
     {
         return value_impl<true>(static_cast<T &&>(x));
     }
@@ -11,6 +11,19 @@
 #include <boost/hana/for_each.hpp>
 #include <boost/type_index.hpp>
 #include <iostream>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <streambuf>
+#include <string>
+
+#if 201703L <= __cplusplus && defined(__has_include)
+#if __has_include(<charconv>)
+#include <charconv>
+#endif
+#include <string_view>
+#endif
 
 
 namespace boost { namespace yap {
@@ -20,7 +33,7 @@ namespace boost { namespace yap {
         "ref" and "term" for the non-operator kinds
         <code>expr_kind::expr_ref</code> amd <code>expr_kind::terminal</code>,
         respectively.*/
-    inline char const * op_string(expr_kind kind)
+    constexpr char const * op_string(expr_kind kind)
     {
         switch (kind) {
         case expr_kind::expr_ref: return "ref";
@@ -315,6 +328,734 @@ namespace boost { namespace yap {
 #endif
     }
 
+    /** The options accepted by <code>print_to()</code>. */
+    struct print_options
+    {
+        /** If false, each node is printed on its own line, with the tree
+            structure shown by indentation, exactly as <code>print()</code>
+            prints it.  If true, the whole expression is printed on a single
+            line, with the operands of each non-terminal in parentheses after
+            it. */
+        bool compact = false;
+
+        /** The string printed once for each level of indentation, when
+            <code>compact</code> is false. */
+        char const * indent = "    ";
+    };
+
+    namespace detail {
+
+        template<typename Buffer>
+        void
+        buffer_append(Buffer & buffer, char const * first, char const * last)
+        {
+            buffer.insert(buffer.end(), first, last);
+        }
+
+        template<typename Buffer>
+        void buffer_append(Buffer & buffer, char const * str)
+        {
+            buffer_append(buffer, str, str + std::strlen(str));
+        }
+
+        // Lets values with only an operator<<() be printed into a buffer.
+        template<typename Buffer>
+        struct buffer_streambuf : std::streambuf
+        {
+            explicit buffer_streambuf(Buffer & buffer) : buffer_(buffer) {}
+
+        protected:
+            int_type overflow(int_type c) override
+            {
+                if (!traits_type::eq_int_type(c, traits_type::eof())) {
+                    char const ch = traits_type::to_char_type(c);
+                    buffer_append(buffer_, &ch, &ch + 1);
+                }
+                return traits_type::not_eof(c);
+            }
+
+            std::streamsize xsputn(char const * s, std::streamsize n) override
+            {
+                buffer_append(buffer_, s, s + n);
+                return n;
+            }
+
+        private:
+            Buffer & buffer_;
+        };
+
+        template<int I>
+        struct print_rank : print_rank<I - 1>
+        {};
+        template<>
+        struct print_rank<0>
+        {};
+
+        template<typename T>
+        struct is_print_char : std::integral_constant<
+                                   bool,
+                                   std::is_same<T, char>::value ||
+                                       std::is_same<T, signed char>::value ||
+                                       std::is_same<T, unsigned char>::value>
+        {};
+
+        template<long long I>
+        std::true_type is_placeholder_value(hana::llong<I> const *);
+        std::false_type is_placeholder_value(...);
+
+        template<typename T>
+        using is_print_placeholder =
+            decltype(is_placeholder_value(std::declval<T const *>()));
+
+        // Each overload below produces the same text that inserting the
+        // value into a default-constructed std::ostream would, as
+        // print_value() does.
+
+        template<typename Buffer, typename T>
+        void print_value_to(Buffer & buffer, T const &, print_rank<0>)
+        {
+            buffer_append(buffer, "<<unprintable-value>>");
+        }
+
+        template<typename Buffer, typename T>
+        auto print_value_to(Buffer & buffer, T const & x, print_rank<1>)
+            -> decltype(std::declval<std::ostream &>() << x, void())
+        {
+            buffer_streambuf<Buffer> streambuf(buffer);
+            std::ostream os(&streambuf);
+            os << x;
+        }
+
+        template<typename Buffer, typename T>
+        auto print_value_to(Buffer & buffer, T const & x, print_rank<2>)
+            -> std::enable_if_t<
+                std::is_integral<T>::value && !std::is_same<T, bool>::value &&
+                !is_print_char<T>::value>
+        {
+            char str[48];
+#ifdef __cpp_lib_to_chars
+            auto const result = std::to_chars(str, str + sizeof(str), x);
+            buffer_append(buffer, str, result.ptr);
+#else
+            int const n =
+                std::is_signed<T>::value
+                    ? std::snprintf(str, sizeof(str), "%lld", (long long)x)
+                    : std::snprintf(
+                          str, sizeof(str), "%llu", (unsigned long long)x);
+            buffer_append(buffer, str, str + n);
+#endif
+        }
+
+        // The default floatfield and precision of a stream are equivalent to
+        // printf()'s "%.6g".
+        template<typename Buffer, typename T>
+        auto print_value_to(Buffer & buffer, T const & x, print_rank<2>)
+            -> std::enable_if_t<std::is_floating_point<T>::value>
+        {
+            char str[64];
+#ifdef __cpp_lib_to_chars
+            auto const result = std::to_chars(
+                str, str + sizeof(str), x, std::chars_format::general, 6);
+            buffer_append(buffer, str, result.ptr);
+#else
+            int const n =
+                std::snprintf(str, sizeof(str), "%.6Lg", (long double)x);
+            buffer_append(buffer, str, str + n);
+#endif
+        }
+
+        template<typename Buffer, typename T>
+        auto print_value_to(Buffer & buffer, T const & x, print_rank<3>)
+            -> std::enable_if_t<std::is_same<T, bool>::value>
+        {
+            buffer_append(buffer, x ? "1" : "0");
+        }
+
+        template<typename Buffer, typename T>
+        auto print_value_to(Buffer & buffer, T const & x, print_rank<3>)
+            -> std::enable_if_t<is_print_char<T>::value>
+        {
+            char const ch = static_cast<char>(x);
+            buffer_append(buffer, &ch, &ch + 1);
+        }
+
+        template<typename Buffer, typename T>
+        auto print_value_to(Buffer & buffer, T const & x, print_rank<3>)
+            -> std::enable_if_t<
+                std::is_same<T, char const *>::value ||
+                std::is_same<T, char *>::value>
+        {
+            buffer_append(buffer, x);
+        }
+
+        template<typename Buffer, typename Traits, typename Allocator>
+        void print_value_to(
+            Buffer & buffer,
+            std::basic_string<char, Traits, Allocator> const & x,
+            print_rank<3>)
+        {
+            buffer_append(buffer, x.data(), x.data() + x.size());
+        }
+
+#if 201703L <= __cplusplus && defined(__has_include)
+        template<typename Buffer, typename Traits>
+        void print_value_to(
+            Buffer & buffer,
+            std::basic_string_view<char, Traits> const & x,
+            print_rank<3>)
+        {
+            buffer_append(buffer, x.data(), x.data() + x.size());
+        }
+#endif
+
+        template<typename Buffer, typename T>
+        auto print_value_to(Buffer & buffer, T const &, print_rank<3>)
+            -> std::enable_if_t<is_print_placeholder<T>::value>
+        {
+            print_value_to(
+                buffer, static_cast<long long>(T::value), print_rank<2>{});
+        }
+
+        // Demangling a type name allocates, so each one is only built once.
+        template<typename T>
+        std::string const & print_type_string()
+        {
+            static std::string const retval = [] {
+                std::string s = typeindex::type_id<T>().pretty_name();
+                if (std::is_const<T>{})
+                    s += " const";
+                if (std::is_volatile<T>{})
+                    s += " volatile";
+                if (std::is_lvalue_reference<T>{})
+                    s += " &";
+                if (std::is_rvalue_reference<T>{})
+                    s += " &&";
+                return s;
+            }();
+            return retval;
+        }
+
+        template<typename Buffer, typename T>
+        void print_terminal_to(Buffer & buffer, void const * value)
+        {
+            std::string const & type = print_type_string<T>();
+            buffer_append(buffer, "term<");
+            buffer_append(buffer, type.data(), type.data() + type.size());
+            buffer_append(buffer, ">[=");
+            print_value_to(
+                buffer,
+                *static_cast<std::remove_reference_t<T> const *>(value),
+                print_rank<3>{});
+            buffer_append(buffer, "]");
+        }
+
+        // print_to() walks a flat, pre-order list of the nodes in an
+        // expression, computed at compile time from the expression's type.
+        // Non-terminals appear as an open and a close event around their
+        // operands; references do not appear at all, except as flags on the
+        // node they refer to.
+
+        enum class print_event_kind { open, terminal, close };
+
+        struct print_event
+        {
+            print_event_kind what;
+            expr_kind kind;
+            int depth;
+            bool is_ref;
+            bool is_const_ref;
+        };
+
+        template<std::size_t N>
+        struct print_plan
+        {
+            print_event events[N];
+        };
+
+        template<std::size_t... N>
+        constexpr std::size_t print_plan_sum()
+        {
+            std::size_t retval = 0;
+            for (std::size_t n : {std::size_t(0), N...}) {
+                retval += n;
+            }
+            return retval;
+        }
+
+        template<typename Expr, expr_kind Kind = remove_cv_ref_t<Expr>::kind>
+        struct print_plan_builder;
+
+        template<typename Tuple>
+        struct print_plan_operands;
+
+        template<typename... T>
+        struct print_plan_operands<hana::tuple<T...>>
+        {
+            static constexpr std::size_t size =
+                print_plan_sum<print_plan_builder<T>::size...>();
+            static constexpr std::size_t terminals =
+                print_plan_sum<print_plan_builder<T>::terminals...>();
+
+            static constexpr void
+            fill(print_event * events, std::size_t & i, int depth)
+            {
+                int const unused[] = {
+                    0,
+                    (print_plan_builder<T>::fill(
+                         events, i, depth, false, false),
+                     0)...};
+                (void)unused;
+            }
+        };
+
+        template<typename Expr, expr_kind Kind>
+        struct print_plan_builder
+        {
+            using operands = print_plan_operands<
+                remove_cv_ref_t<decltype(std::declval<Expr>().elements)>>;
+
+            static constexpr std::size_t size = operands::size + 2;
+            static constexpr std::size_t terminals = operands::terminals;
+
+            static constexpr void fill(
+                print_event * events,
+                std::size_t & i,
+                int depth,
+                bool is_ref,
+                bool is_const_ref)
+            {
+                events[i++] = print_event{
+                    print_event_kind::open, Kind, depth, is_ref, is_const_ref};
+                operands::fill(events, i, depth + 1);
+                events[i++] = print_event{
+                    print_event_kind::close, Kind, depth, false, false};
+            }
+        };
+
+        template<typename Expr>
+        struct print_plan_builder<Expr, expr_kind::terminal>
+        {
+            static constexpr std::size_t size = 1;
+            static constexpr std::size_t terminals = 1;
+
+            static constexpr void fill(
+                print_event * events,
+                std::size_t & i,
+                int depth,
+                bool is_ref,
+                bool is_const_ref)
+            {
+                events[i++] = print_event{print_event_kind::terminal,
+                                          expr_kind::terminal,
+                                          depth,
+                                          is_ref,
+                                          is_const_ref};
+            }
+        };
+
+        template<typename Expr>
+        struct print_plan_builder<Expr, expr_kind::expr_ref>
+        {
+            using referent_type = std::remove_pointer_t<remove_cv_ref_t<
+                decltype(std::declval<Expr>().elements[hana::llong_c<0>])>>;
+            using referent = print_plan_builder<referent_type>;
+
+            static constexpr std::size_t size = referent::size;
+            static constexpr std::size_t terminals = referent::terminals;
+
+            static constexpr void fill(
+                print_event * events,
+                std::size_t & i,
+                int depth,
+                bool,
+                bool)
+            {
+                referent::fill(
+                    events, i, depth, true, std::is_const<referent_type>{});
+            }
+        };
+
+        template<typename Expr>
+        constexpr print_plan<print_plan_builder<Expr>::size> make_print_plan()
+        {
+            print_plan<print_plan_builder<Expr>::size> retval{};
+            std::size_t i = 0;
+            print_plan_builder<Expr>::fill(retval.events, i, 0, false, false);
+            return retval;
+        }
+
+        // The value of each terminal, in the order the plan visits them,
+        // along with the function that prints it.
+        template<typename Buffer>
+        struct print_terminal_slot
+        {
+            void const * value;
+            void (*print)(Buffer &, void const *);
+        };
+
+        template<typename Tuple>
+        struct print_terminal_type;
+        template<typename T>
+        struct print_terminal_type<hana::tuple<T>>
+        {
+            using type = T;
+        };
+
+        template<expr_kind Kind>
+        struct print_terminal_gatherer
+        {
+            template<typename Buffer, typename Expr>
+            static void
+            call(Expr const & expr, print_terminal_slot<Buffer> *& slot)
+            {
+                hana::for_each(expr.elements, [&slot](auto const & element) {
+                    using element_type = remove_cv_ref_t<decltype(element)>;
+                    print_terminal_gatherer<element_type::kind>::call(
+                        element, slot);
+                });
+            }
+        };
+
+        template<>
+        struct print_terminal_gatherer<expr_kind::expr_ref>
+        {
+            template<typename Buffer, typename Expr>
+            static void
+            call(Expr const & expr, print_terminal_slot<Buffer> *& slot)
+            {
+                using referent_type =
+                    remove_cv_ref_t<decltype(::boost::yap::deref(expr))>;
+                print_terminal_gatherer<referent_type::kind>::call(
+                    ::boost::yap::deref(expr), slot);
+            }
+        };
+
+        template<>
+        struct print_terminal_gatherer<expr_kind::terminal>
+        {
+            template<typename Buffer, typename Expr>
+            static void
+            call(Expr const & expr, print_terminal_slot<Buffer> *& slot)
+            {
+                using value_type = typename print_terminal_type<
+                    remove_cv_ref_t<decltype(expr.elements)>>::type;
+                slot->value = std::addressof(expr.elements[hana::llong_c<0>]);
+                slot->print = &print_terminal_to<Buffer, value_type>;
+                ++slot;
+            }
+        };
+
+        template<typename Buffer>
+        void print_ref_suffix_to(Buffer & buffer, print_event const & event)
+        {
+            if (event.is_const_ref)
+                buffer_append(buffer, " const &");
+            else if (event.is_ref)
+                buffer_append(buffer, " &");
+        }
+    }
+
+    /** Appends expression \a expr to \a buffer, and returns \a buffer.
+        <code>Buffer</code> may be any sequence of <code>char</code> with an
+        <code>insert(end(), first, last)</code> member, such as
+        <code>std::string</code> or <code>std::vector<char></code>.
+
+        With the default options, the text appended is the same as
+        <code>print()</code> writes.  Unlike <code>print()</code>, no stream
+        is involved, and arithmetic values, strings, and placeholders are
+        formatted directly into \a buffer; other values are printed through
+        their <code>operator<<()</code>.  Apart from growing \a buffer, and
+        building each type name the first time it is printed, nothing is
+        allocated.
+
+        The nodes are visited in a single loop over a list computed at compile
+        time, so printing does not recurse, however deep \a expr is. */
+    template<typename Buffer, typename Expr>
+    Buffer & print_to(
+        Buffer & buffer,
+        Expr const & expr,
+        print_options const & options = print_options())
+    {
+        using builder = detail::print_plan_builder<Expr>;
+        static constexpr auto plan = detail::make_print_plan<Expr>();
+
+        detail::print_terminal_slot<Buffer> slots[builder::terminals];
+        detail::print_terminal_slot<Buffer> * slot = slots;
+        detail::print_terminal_gatherer<Expr::kind>::call(expr, slot);
+        slot = slots;
+
+        bool separate = false;
+        for (detail::print_event const & event : plan.events) {
+            if (event.what == detail::print_event_kind::close) {
+                if (options.compact) {
+                    detail::buffer_append(buffer, ")");
+                    separate = true;
+                }
+                continue;
+            }
+
+            if (options.compact) {
+                if (separate)
+                    detail::buffer_append(buffer, ", ");
+            } else {
+                for (int i = 0; i < event.depth; ++i) {
+                    detail::buffer_append(buffer, options.indent);
+                }
+            }
+
+            if (event.what == detail::print_event_kind::terminal) {
+                slot->print(buffer, slot->value);
+                ++slot;
+                detail::print_ref_suffix_to(buffer, event);
+                separate = true;
+            } else {
+                detail::buffer_append(buffer, "expr<");
+                detail::buffer_append(buffer, op_string(event.kind));
+                detail::buffer_append(buffer, ">");
+                detail::print_ref_suffix_to(buffer, event);
+                if (options.compact)
+                    detail::buffer_append(buffer, "(");
+                separate = false;
+            }
+
+            if (!options.compact)
+                detail::buffer_append(buffer, "\n");
+        }
+
+        return buffer;
+    }
+
+    /** A fixed-size, null-terminated string, usable in constant
+        expressions.  This is the type of <code>type_string_v</code>. */
+    template<std::size_t N>
+    struct fixed_string
+    {
+        /** The characters of the string, followed by a null terminator. */
+        char data_[N + 1];
+
+        static constexpr std::size_t size() noexcept { return N; }
+
+        constexpr char const * c_str() const noexcept { return data_; }
+        constexpr char const * begin() const noexcept { return data_; }
+        constexpr char const * end() const noexcept { return data_ + N; }
+
+        constexpr char operator[](std::size_t i) const noexcept
+        {
+            return data_[i];
+        }
+
+#if 201703L <= __cplusplus && defined(__has_include)
+        constexpr operator std::string_view() const noexcept
+        {
+            return std::string_view(data_, N);
+        }
+#endif
+    };
+
+    template<std::size_t N, std::size_t M>
+    constexpr bool
+    operator==(fixed_string<N> const & lhs, char const (&rhs)[M]) noexcept
+    {
+        if (N + 1 != M)
+            return false;
+        for (std::size_t i = 0; i < N; ++i) {
+            if (lhs[i] != rhs[i])
+                return false;
+        }
+        return true;
+    }
+
+    template<std::size_t N, std::size_t M>
+    constexpr bool
+    operator!=(fixed_string<N> const & lhs, char const (&rhs)[M]) noexcept
+    {
+        return !(lhs == rhs);
+    }
+
+    template<std::size_t N, std::size_t M>
+    constexpr bool
+    operator==(
+        fixed_string<N> const & lhs, fixed_string<M> const & rhs) noexcept
+    {
+        return lhs == rhs.data_;
+    }
+
+    template<std::size_t N, std::size_t M>
+    constexpr bool
+    operator!=(
+        fixed_string<N> const & lhs, fixed_string<M> const & rhs) noexcept
+    {
+        return !(lhs == rhs);
+    }
+
+    namespace detail {
+
+        // Counts the characters written when out is null.
+        struct type_string_writer
+        {
+            char * out;
+            std::size_t size;
+
+            constexpr void put(char c)
+            {
+                if (out)
+                    out[size] = c;
+                ++size;
+            }
+
+            constexpr void put(char const * str)
+            {
+                while (*str) {
+                    put(*str++);
+                }
+            }
+
+            constexpr void put(long long n)
+            {
+                if (n < 0) {
+                    put('-');
+                    n = -n;
+                }
+                if (10 <= n)
+                    put(n / 10);
+                put(static_cast<char>('0' + n % 10));
+            }
+
+            constexpr void put_ref_suffix(bool is_ref, bool is_const_ref)
+            {
+                if (is_const_ref)
+                    put(" const &");
+                else if (is_ref)
+                    put(" &");
+            }
+        };
+
+        template<typename Expr, expr_kind Kind = remove_cv_ref_t<Expr>::kind>
+        struct type_string_builder;
+
+        template<typename Tuple>
+        struct type_string_operands;
+
+        template<typename... T>
+        struct type_string_operands<hana::tuple<T...>>
+        {
+            static constexpr void write(type_string_writer & writer)
+            {
+                bool first = true;
+                int const unused[] = {
+                    0,
+                    ((first ? (void)(first = false) : writer.put(", ")),
+                     type_string_builder<T>::write(writer, false, false),
+                     0)...};
+                (void)unused;
+            }
+        };
+
+        template<typename Expr, expr_kind Kind>
+        struct type_string_builder
+        {
+            static constexpr void
+            write(type_string_writer & writer, bool is_ref, bool is_const_ref)
+            {
+                writer.put("expr<");
+                writer.put(op_string(Kind));
+                writer.put(">");
+                writer.put_ref_suffix(is_ref, is_const_ref);
+                writer.put("(");
+                type_string_operands<remove_cv_ref_t<decltype(
+                    std::declval<Expr>().elements)>>::write(writer);
+                writer.put(")");
+            }
+        };
+
+        template<typename Expr>
+        struct type_string_builder<Expr, expr_kind::terminal>
+        {
+            using value_type = remove_cv_ref_t<typename print_terminal_type<
+                remove_cv_ref_t<decltype(std::declval<Expr>().elements)>>::
+                                                   type>;
+
+            template<typename T>
+            static constexpr void
+            write_value(type_string_writer & writer, std::true_type)
+            {
+                writer.put(static_cast<long long>(T::value));
+                writer.put("_p");
+            }
+
+            template<typename T>
+            static constexpr void
+            write_value(type_string_writer & writer, std::false_type)
+            {
+                writer.put("term");
+            }
+
+            static constexpr void
+            write(type_string_writer & writer, bool is_ref, bool is_const_ref)
+            {
+                write_value<value_type>(
+                    writer, is_print_placeholder<value_type>{});
+                writer.put_ref_suffix(is_ref, is_const_ref);
+            }
+        };
+
+        template<typename Expr>
+        struct type_string_builder<Expr, expr_kind::expr_ref>
+        {
+            using referent_type = std::remove_pointer_t<remove_cv_ref_t<
+                decltype(std::declval<Expr>().elements[hana::llong_c<0>])>>;
+
+            static constexpr void
+            write(type_string_writer & writer, bool, bool)
+            {
+                type_string_builder<referent_type>::write(
+                    writer, true, std::is_const<referent_type>{});
+            }
+        };
+
+        template<typename Expr>
+        constexpr std::size_t type_string_size()
+        {
+            type_string_writer writer{nullptr, 0};
+            type_string_builder<Expr>::write(writer, false, false);
+            return writer.size;
+        }
+
+        template<typename Expr>
+        constexpr fixed_string<type_string_size<Expr>()> make_type_string()
+        {
+            fixed_string<type_string_size<Expr>()> retval{};
+            type_string_writer writer{retval.data_, 0};
+            type_string_builder<Expr>::write(writer, false, false);
+            return retval;
+        }
+    }
+
+    /** The structure of expression type <code>Expr</code>, as a
+        <code>fixed_string</code>.  The format is the same as the compact form
+        of <code>print_to()</code>, except that terminals are written
+        <code>term</code>, without their types or values, and placeholder
+        terminals are written <code>I_p</code>, where <code>I</code> is the
+        placeholder's index.  For example, the type of <code>1_p * x + 2</code>
+        where <code>x</code> is an lvalue terminal gives
+        <code>expr<+>(expr<*>(1_p, term &), term)</code>. */
+    template<typename Expr>
+    struct type_string
+    {
+        using value_type = fixed_string<
+            detail::type_string_size<detail::remove_cv_ref_t<Expr>>()>;
+
+        static constexpr value_type value =
+            detail::make_type_string<detail::remove_cv_ref_t<Expr>>();
+    };
+
+    template<typename Expr>
+    constexpr typename type_string<Expr>::value_type type_string<Expr>::value;
+
+    /** The <code>value</code> of <code>type_string<Expr></code>. */
+    template<typename Expr>
+    constexpr auto const & type_string_v = type_string<Expr>::value;
+
 }}
 
 #endif
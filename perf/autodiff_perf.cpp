@@ -0,0 +1,424 @@
+// Copyright (C) 2016-2018 T. Zachary Laine
+//
+// Distributed under the Boost Software License, Version 1.0. (See
+// accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+#include "autodiff.h"
+#include "autodiff_expr.hpp"
+#include "FlatTape.h"
+
+#include <boost/yap/algorithm.hpp>
+
+#include <string>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+
+using namespace AutoDiff;
+
+// Builds the Node graph of an expression, as the xform in
+// example/autodiff_library/autodiff_expr.hpp does, except that placeholder I
+// stands for args_[I - 1].  This lets one small expression be instantiated
+// as each term of a large objective.
+struct instantiate_xform
+{
+    template<long long I>
+    Node * operator()(
+        boost::yap::expr_tag<boost::yap::expr_kind::terminal>,
+        boost::yap::placeholder<I>)
+    {
+        return args_[I - 1];
+    }
+
+    Node * operator()(
+        boost::yap::expr_tag<boost::yap::expr_kind::terminal>, double x)
+    {
+        return create_param_node(x);
+    }
+
+    template<boost::yap::expr_kind Kind, typename Expr1, typename Expr2>
+    Node * operator()(
+        boost::yap::expr_tag<Kind>, Expr1 const & expr1, Expr2 const & expr2)
+    {
+        return create_binary_op_node(
+            xform::op_for_kind(Kind),
+            boost::yap::transform(
+                boost::yap::as_expr<autodiff_expr>(expr1), *this),
+            boost::yap::transform(
+                boost::yap::as_expr<autodiff_expr>(expr2), *this));
+    }
+
+    std::vector<Node *> const & args_;
+};
+
+template<typename Expr>
+Node * instantiate(Expr const & expr, std::vector<Node *> const & args)
+{
+    return boost::yap::transform(expr, instantiate_xform{args});
+}
+
+Node * add_term(Node * sum, Node * term)
+{
+    return sum ? create_binary_op_node(OP_PLUS, sum, term) : term;
+}
+
+
+// The synthetic objectives.  Each builds its graph over the n variables in
+// vars with yap, and provides the hand-derived value, gradient and Hessian
+// that serve as the baseline.
+
+// f = sum (x_i - 1)^2, with a diagonal Hessian.
+struct sum_of_squares
+{
+    static bool const sparse = true;
+
+    static Node * build(std::vector<Node *> & vars)
+    {
+        using namespace autodiff_placeholders;
+        Node * retval = nullptr;
+        for (std::size_t i = 0; i < vars.size(); ++i) {
+            retval = add_term(
+                retval, instantiate((1_p - 1.0) * (1_p - 1.0), {vars[i]}));
+        }
+        return retval;
+    }
+
+    static double value(std::vector<double> const & x)
+    {
+        double retval = 0;
+        for (double xi : x) {
+            retval += (xi - 1) * (xi - 1);
+        }
+        return retval;
+    }
+
+    static void gradient(std::vector<double> const & x, std::vector<double> & g)
+    {
+        for (std::size_t i = 0; i < x.size(); ++i) {
+            g[i] = 2 * (x[i] - 1);
+        }
+    }
+
+    static void hessian(std::vector<double> const & x, col_compress_matrix & h)
+    {
+        for (std::size_t i = 0; i < x.size(); ++i) {
+            h(i, i) = 2;
+        }
+    }
+};
+
+// f = sum 100 (x_{i+1} - x_i^2)^2 + (1 - x_i)^2, with a tridiagonal Hessian.
+struct rosenbrock
+{
+    static bool const sparse = true;
+
+    static Node * build(std::vector<Node *> & vars)
+    {
+        using namespace autodiff_placeholders;
+        Node * retval = nullptr;
+        for (std::size_t i = 0; i + 1 < vars.size(); ++i) {
+            retval = add_term(
+                retval,
+                instantiate(
+                    100.0 * (2_p - 1_p * 1_p) * (2_p - 1_p * 1_p) +
+                        (1.0 - 1_p) * (1.0 - 1_p),
+                    {vars[i], vars[i + 1]}));
+        }
+        return retval;
+    }
+
+    static double value(std::vector<double> const & x)
+    {
+        double retval = 0;
+        for (std::size_t i = 0; i + 1 < x.size(); ++i) {
+            double const r = x[i + 1] - x[i] * x[i];
+            retval += 100 * r * r + (1 - x[i]) * (1 - x[i]);
+        }
+        return retval;
+    }
+
+    static void gradient(std::vector<double> const & x, std::vector<double> & g)
+    {
+        std::fill(g.begin(), g.end(), 0.0);
+        for (std::size_t i = 0; i + 1 < x.size(); ++i) {
+            double const r = x[i + 1] - x[i] * x[i];
+            g[i] += -400 * x[i] * r - 2 * (1 - x[i]);
+            g[i + 1] += 200 * r;
+        }
+    }
+
+    static void hessian(std::vector<double> const & x, col_compress_matrix & h)
+    {
+        std::size_t const n = x.size();
+        for (std::size_t j = 0; j < n; ++j) {
+            // Column j, in row order.
+            if (0 < j)
+                h(j - 1, j) = -400 * x[j - 1];
+            double d = 0;
+            if (0 < j)
+                d += 200;
+            if (j + 1 < n)
+                d += 1200 * x[j] * x[j] - 400 * x[j + 1] + 2;
+            h(j, j) = d;
+            if (j + 1 < n)
+                h(j + 1, j) = -400 * x[j];
+        }
+    }
+};
+
+// f = s^2 + s, where s = sum x_i, with a dense Hessian.
+struct dense_square
+{
+    static bool const sparse = false;
+
+    static Node * build(std::vector<Node *> & vars)
+    {
+        using namespace autodiff_placeholders;
+        Node * s = nullptr;
+        for (std::size_t i = 0; i < vars.size(); ++i) {
+            s = add_term(s, vars[i]);
+        }
+        return instantiate(1_p * 1_p + 1_p, {s});
+    }
+
+    static double value(std::vector<double> const & x)
+    {
+        double s = 0;
+        for (double xi : x) {
+            s += xi;
+        }
+        return s * s + s;
+    }
+
+    static void gradient(std::vector<double> const & x, std::vector<double> & g)
+    {
+        double s = 0;
+        for (double xi : x) {
+            s += xi;
+        }
+        std::fill(g.begin(), g.end(), 2 * s + 1);
+    }
+
+    static void hessian(std::vector<double> const & x, col_compress_matrix & h)
+    {
+        for (std::size_t j = 0; j < x.size(); ++j) {
+            for (std::size_t i = 0; i < x.size(); ++i) {
+                h(i, j) = 2;
+            }
+        }
+    }
+};
+
+
+std::vector<double> make_point(std::size_t n)
+{
+    std::vector<double> retval(n);
+    for (std::size_t i = 0; i < n; ++i) {
+        retval[i] = 0.5 + 0.01 * i;
+    }
+    return retval;
+}
+
+// Creates the variables of an n-variable objective, set to make_point(n),
+// and builds its graph.
+template<typename Objective>
+Node * build_objective(std::size_t n, std::vector<Node *> & vars)
+{
+    std::vector<double> const x = make_point(n);
+    vars.clear();
+    for (std::size_t i = 0; i < n; ++i) {
+        vars.push_back(create_var_node(x[i]));
+    }
+    return Objective::build(vars);
+}
+
+// Each benchmark sets up and cleans up the tapes, stacks and nodes of the
+// calling thread itself, so that what one leaves behind does not affect the
+// next.
+struct autodiff_scope
+{
+    autodiff_scope() { autodiff_setup(); }
+    ~autodiff_scope() { autodiff_cleanup(); }
+};
+
+
+// Graph construction: nodes built per second, and the bytes of node pool
+// used per node.
+template<typename Objective>
+void BM_build(benchmark::State & state)
+{
+    autodiff_scope scope;
+    std::size_t const n = state.range(0);
+    std::vector<Node *> vars;
+    std::size_t iterations = 0;
+    std::size_t nodes = 0;
+    std::size_t bytes = 0;
+    while (state.KeepRunning()) {
+        reset_nodes();
+        benchmark::DoNotOptimize(build_objective<Objective>(n, vars));
+        nodes = node_pool().size();
+        bytes = node_pool().bytesUsed();
+        ++iterations;
+    }
+    state.SetItemsProcessed(iterations * nodes);
+    state.SetLabel(
+        "nodes=" + std::to_string(nodes) +
+        " bytes/node=" + std::to_string(bytes / nodes));
+}
+
+template<typename Objective>
+void BM_eval_function(benchmark::State & state)
+{
+    autodiff_scope scope;
+    std::vector<Node *> vars;
+    Node * root = build_objective<Objective>(state.range(0), vars);
+    std::size_t const nodes = node_pool().size();
+    std::size_t iterations = 0;
+    while (state.KeepRunning()) {
+        benchmark::DoNotOptimize(eval_function(root));
+        ++iterations;
+    }
+    state.SetItemsProcessed(iterations * nodes);
+}
+
+template<typename Objective>
+void BM_eval_function_by_hand(benchmark::State & state)
+{
+    std::vector<double> const x = make_point(state.range(0));
+    while (state.KeepRunning()) {
+        benchmark::DoNotOptimize(Objective::value(x));
+    }
+}
+
+// Gradients: gradient entries computed per second.
+template<typename Objective>
+void BM_grad_reverse(benchmark::State & state)
+{
+    autodiff_scope scope;
+    std::size_t const n = state.range(0);
+    std::vector<Node *> vars;
+    Node * root = build_objective<Objective>(n, vars);
+    std::vector<double> grad;
+    std::size_t iterations = 0;
+    while (state.KeepRunning()) {
+        benchmark::DoNotOptimize(grad_reverse(root, vars, grad));
+        ++iterations;
+    }
+    state.SetItemsProcessed(iterations * n);
+}
+
+template<typename Objective>
+void BM_grad_by_hand(benchmark::State & state)
+{
+    std::size_t const n = state.range(0);
+    std::vector<double> const x = make_point(n);
+    std::vector<double> grad(n);
+    std::size_t iterations = 0;
+    while (state.KeepRunning()) {
+        Objective::gradient(x, grad);
+        benchmark::DoNotOptimize(grad.data());
+        ++iterations;
+    }
+    state.SetItemsProcessed(iterations * n);
+}
+
+template<typename T>
+std::size_t vector_bytes(std::vector<T> const & v)
+{
+    return v.size() * sizeof(T);
+}
+
+// The bytes held by the per-entry arrays of a FlatTape, including the
+// tangents and second order adjoints of a block of directions.
+std::size_t flat_tape_bytes(FlatTape const & tape)
+{
+    return vector_bytes(tape.code) + vector_bytes(tape.left) +
+           vector_bytes(tape.right) + vector_bytes(tape.val) +
+           vector_bytes(tape.left_partial) + vector_bytes(tape.right_partial) +
+           vector_bytes(tape.adj) + vector_bytes(tape.left_left_partial) +
+           vector_bytes(tape.left_right_partial) +
+           vector_bytes(tape.right_right_partial) +
+           vector_bytes(tape.tangent) + vector_bytes(tape.tangent_adj);
+}
+
+// Hessians: sparse objectives use hess_reverse_sparse(), and dense ones the
+// blocked hess_reverse().  Both lower the graph onto a FlatTape and
+// propagate blocks of FlatTape::HESS_BLOCK directions over it, so the size
+// of that tape is reported.  It is measured on a tape lowered the same way,
+// after a Hessian*vector product, which fills in the same arrays.
+template<typename Objective>
+void BM_hess_reverse(benchmark::State & state)
+{
+    autodiff_scope scope;
+    std::size_t const n = state.range(0);
+    std::vector<Node *> vars;
+    Node * root = build_objective<Objective>(n, vars);
+
+    FlatTape tape;
+    flat_tape(root, vars, tape);
+    std::vector<double> const x = make_point(n);
+    std::vector<double> dir(n), hv(n);
+    dir[0] = 1;
+    tape.hess_vec_reverse(x.data(), dir.data(), 1, hv.data());
+    std::size_t const tape_bytes = flat_tape_bytes(tape);
+
+    while (state.KeepRunning()) {
+        col_compress_matrix hess(n, n);
+        if (Objective::sparse)
+            benchmark::DoNotOptimize(hess_reverse_sparse(root, vars, hess));
+        else
+            benchmark::DoNotOptimize(hess_reverse(root, vars, hess));
+    }
+    state.SetLabel(
+        "tape_entries=" + std::to_string(tape.size()) +
+        " tape_bytes=" + std::to_string(tape_bytes));
+}
+
+// The dependency-aware forward mode Hessian.
+template<typename Objective>
+void BM_hess_forward(benchmark::State & state)
+{
+    autodiff_scope scope;
+    std::size_t const n = state.range(0);
+    std::vector<Node *> vars;
+    Node * root = build_objective<Objective>(n, vars);
+    std::vector<double> grad;
+    while (state.KeepRunning()) {
+        col_compress_matrix hess(n, n);
+        benchmark::DoNotOptimize(hess_forward(root, vars, grad, hess));
+    }
+}
+
+template<typename Objective>
+void BM_hess_by_hand(benchmark::State & state)
+{
+    std::size_t const n = state.range(0);
+    std::vector<double> const x = make_point(n);
+    while (state.KeepRunning()) {
+        col_compress_matrix hess(n, n);
+        Objective::hessian(x, hess);
+        benchmark::DoNotOptimize(hess.nnz());
+    }
+}
+
+
+#define AUTODIFF_BENCHMARK(fn, objective, max_n)                              \
+    BENCHMARK_TEMPLATE(fn, objective)->RangeMultiplier(4)->Range(16, max_n)
+
+#define AUTODIFF_BENCHMARKS(objective, max_hess_n)                             \
+    AUTODIFF_BENCHMARK(BM_build, objective, 4096);                             \
+    AUTODIFF_BENCHMARK(BM_eval_function, objective, 4096);                     \
+    AUTODIFF_BENCHMARK(BM_eval_function_by_hand, objective, 4096);             \
+    AUTODIFF_BENCHMARK(BM_grad_reverse, objective, 4096);                      \
+    AUTODIFF_BENCHMARK(BM_grad_by_hand, objective, 4096);                      \
+    AUTODIFF_BENCHMARK(BM_hess_reverse, objective, max_hess_n);                \
+    AUTODIFF_BENCHMARK(BM_hess_forward, objective, max_hess_n);                \
+    AUTODIFF_BENCHMARK(BM_hess_by_hand, objective, max_hess_n)
+
+AUTODIFF_BENCHMARKS(sum_of_squares, 4096);
+AUTODIFF_BENCHMARKS(rosenbrock, 4096);
+// The dense Hessian has n^2 entries, so it gets smaller sizes.
+AUTODIFF_BENCHMARKS(dense_square, 256);
+
+BENCHMARK_MAIN()
@@ -6,14 +6,18 @@
 #include <boost/yap/expression.hpp>
 
 #include <boost/assign/list_of.hpp>
+#include <boost/container/flat_map.hpp>
 
+#include <algorithm>
+#include <array>
 #include <map>
+#include <unordered_map>
 #include <iostream>
 
 #include <benchmark/benchmark.h>
 
 
-template<typename Key, typename Value, typename Allocator>
+template<typename Map>
 struct map_list_of_transform
 {
     template<typename Fn, typename Key2, typename Value2>
@@ -26,14 +30,51 @@ struct map_list_of_transform
         boost::yap::transform(
             boost::yap::as_expr<boost::yap::minimal_expr>(fn), *this);
         map.emplace(
-            Key{std::forward<Key2 &&>(key)},
-            Value{std::forward<Value2 &&>(value)});
+            typename Map::key_type{std::forward<Key2 &&>(key)},
+            typename Map::mapped_type{std::forward<Value2 &&>(value)});
         return 0;
     }
 
-    std::map<Key, Value, Allocator> map;
+    Map map;
 };
 
+template<typename Key, typename Value, std::size_t N>
+struct map_list_of_array_transform
+{
+    template<typename Fn, typename Key2, typename Value2>
+    auto operator()(
+        boost::yap::expr_tag<boost::yap::expr_kind::call>,
+        Fn const & fn,
+        Key2 && key,
+        Value2 && value)
+    {
+        boost::yap::transform(
+            boost::yap::as_expr<boost::yap::minimal_expr>(fn), *this);
+        entries[size].first = std::forward<Key2 &&>(key);
+        entries[size].second = std::forward<Value2 &&>(value);
+        ++size;
+        return 0;
+    }
+
+    std::array<std::pair<Key, Value>, N> entries;
+    std::size_t size;
+};
+
+template<
+    typename Expr,
+    bool IsCall = Expr::kind == boost::yap::expr_kind::call>
+struct map_list_of_size : std::integral_constant<std::size_t, 0>
+{};
+
+template<typename Expr>
+struct map_list_of_size<Expr, true>
+    : std::integral_constant<
+          std::size_t,
+          1 + map_list_of_size<std::decay_t<decltype(
+                  std::declval<Expr>().elements[boost::hana::llong_c<0>])>>::
+                  value>
+{};
+
 
 template<boost::yap::expr_kind Kind, typename Tuple>
 struct map_list_of_expr
@@ -45,11 +86,58 @@ struct map_list_of_expr
     template<typename Key, typename Value, typename Allocator>
     operator std::map<Key, Value, Allocator>() const
     {
-        map_list_of_transform<Key, Value, Allocator> transform;
+        map_list_of_transform<std::map<Key, Value, Allocator>> transform;
         boost::yap::transform(*this, transform);
         return transform.map;
     }
 
+    template<
+        typename Key,
+        typename Value,
+        typename Hash,
+        typename Equal,
+        typename Allocator>
+    operator std::unordered_map<Key, Value, Hash, Equal, Allocator>() const
+    {
+        map_list_of_transform<
+            std::unordered_map<Key, Value, Hash, Equal, Allocator>>
+            transform;
+        transform.map.reserve(map_list_of_size<map_list_of_expr>::value);
+        boost::yap::transform(*this, transform);
+        return transform.map;
+    }
+
+    template<
+        typename Key,
+        typename Value,
+        typename Compare,
+        typename Allocator>
+    operator boost::container::flat_map<Key, Value, Compare, Allocator>() const
+    {
+        constexpr std::size_t N = map_list_of_size<map_list_of_expr>::value;
+        map_list_of_array_transform<Key, Value, N> transform{{}, 0};
+        boost::yap::transform(*this, transform);
+
+        Compare compare;
+        auto const less = [&](auto const & lhs, auto const & rhs) {
+            return compare(lhs.first, rhs.first);
+        };
+        auto & entries = transform.entries;
+        std::stable_sort(entries.begin(), entries.end(), less);
+        auto const last = std::unique(
+            entries.begin(),
+            entries.end(),
+            [&](auto const & lhs, auto const & rhs) { return !less(lhs, rhs); });
+
+        boost::container::flat_map<Key, Value, Compare, Allocator> retval;
+        retval.reserve(last - entries.begin());
+        retval.insert(
+            boost::container::ordered_unique_range,
+            std::make_move_iterator(entries.begin()),
+            std::make_move_iterator(last));
+        return retval;
+    }
+
     BOOST_YAP_USER_CALL_OPERATOR(::map_list_of_expr)
 };
 
@@ -154,9 +242,115 @@ void BM_make_map_inializer_list(benchmark::State & state)
     std::cout << "Sum of ints in all maps made=" << i << "\n";
 }
 
+template<typename Map>
+void make_map_loop(benchmark::State & state, Map (*make_map)())
+{
+    int i = 0;
+    while (state.KeepRunning()) {
+        {
+            Map map = make_map();
+            state.PauseTiming();
+            for (auto && x : map) {
+                i += x.second;
+            }
+        }
+        state.ResumeTiming();
+    }
+    std::cout << "Sum of ints in all maps made=" << i << "\n";
+}
+
+using flat_map_t = boost::container::flat_map<std::string, int>;
+
+flat_map_t make_flat_map_with_boost_yap()
+{
+    return map_list_of("<", 1)("<=", 2)(">", 3)(">=", 4)("=", 5)("<>", 6);
+}
+
+void BM_make_flat_map_with_boost_yap(benchmark::State & state)
+{
+    make_map_loop(state, make_flat_map_with_boost_yap);
+}
+
+flat_map_t make_flat_map_manually()
+{
+    flat_map_t retval;
+    retval.reserve(6);
+    retval.emplace("<", 1);
+    retval.emplace("<=", 2);
+    retval.emplace(">", 3);
+    retval.emplace(">=", 4);
+    retval.emplace("=", 5);
+    retval.emplace("<>", 6);
+    return retval;
+}
+
+void BM_make_flat_map_manually(benchmark::State & state)
+{
+    make_map_loop(state, make_flat_map_manually);
+}
+
+flat_map_t make_flat_map_inializer_list()
+{
+    flat_map_t retval = {
+        {"<", 1}, {"<=", 2}, {">", 3}, {">=", 4}, {"=", 5}, {"<>", 6}};
+    return retval;
+}
+
+void BM_make_flat_map_inializer_list(benchmark::State & state)
+{
+    make_map_loop(state, make_flat_map_inializer_list);
+}
+
+using unordered_map_t = std::unordered_map<std::string, int>;
+
+unordered_map_t make_unordered_map_with_boost_yap()
+{
+    return map_list_of("<", 1)("<=", 2)(">", 3)(">=", 4)("=", 5)("<>", 6);
+}
+
+void BM_make_unordered_map_with_boost_yap(benchmark::State & state)
+{
+    make_map_loop(state, make_unordered_map_with_boost_yap);
+}
+
+unordered_map_t make_unordered_map_manually()
+{
+    unordered_map_t retval;
+    retval.emplace("<", 1);
+    retval.emplace("<=", 2);
+    retval.emplace(">", 3);
+    retval.emplace(">=", 4);
+    retval.emplace("=", 5);
+    retval.emplace("<>", 6);
+    return retval;
+}
+
+void BM_make_unordered_map_manually(benchmark::State & state)
+{
+    make_map_loop(state, make_unordered_map_manually);
+}
+
+unordered_map_t make_unordered_map_inializer_list()
+{
+    unordered_map_t retval = {
+        {"<", 1}, {"<=", 2}, {">", 3}, {">=", 4}, {"=", 5}, {"<>", 6}};
+    return retval;
+}
+
+void BM_make_unordered_map_inializer_list(benchmark::State & state)
+{
+    make_map_loop(state, make_unordered_map_inializer_list);
+}
+
 BENCHMARK(BM_make_map_with_boost_yap);
 BENCHMARK(BM_make_map_with_boost_assign);
 BENCHMARK(BM_make_map_manually);
 BENCHMARK(BM_make_map_inializer_list);
+BENCHMARK(BM_make_flat_map_with_boost_yap);
+BENCHMARK(BM_make_flat_map_manually);
+BENCHMARK(BM_make_flat_map_inializer_list);
+BENCHMARK(BM_make_unordered_map_with_boost_yap);
+BENCHMARK(BM_make_unordered_map_manually);
+BENCHMARK(BM_make_unordered_map_inializer_list);
 
 BENCHMARK_MAIN()
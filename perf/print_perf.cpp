@@ -0,0 +1,79 @@
+// Copyright (C) 2016-2018 T. Zachary Laine
+//
+// Distributed under the Boost Software License, Version 1.0. (See
+// accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+#include <boost/yap/expression.hpp>
+#include <boost/yap/print.hpp>
+
+#include <sstream>
+
+#include <benchmark/benchmark.h>
+
+
+template<typename T>
+using term = boost::yap::terminal<boost::yap::expression, T>;
+
+namespace yap = boost::yap;
+
+
+term<double> x{1.5};
+term<int> n{42};
+term<char const *> name{"name"};
+
+// Each level refers to the one before it twice, so the printed tree has about
+// 200 nodes, most of them references.
+auto const level_0 = x * n + x / 2.0 - name;
+auto const level_1 = level_0 * level_0 + x;
+auto const level_2 = level_1 - level_1 / n;
+auto const level_3 = level_2 + -level_2;
+auto const level_4 = level_3 * level_3;
+auto const & expr = level_4;
+
+void BM_print_ostream(benchmark::State & state)
+{
+    while (state.KeepRunning()) {
+        std::ostringstream oss;
+        yap::print(oss, expr);
+        benchmark::DoNotOptimize(oss.str());
+    }
+}
+
+void BM_print_ostream_reused(benchmark::State & state)
+{
+    std::ostringstream oss;
+    while (state.KeepRunning()) {
+        oss.str("");
+        yap::print(oss, expr);
+        benchmark::DoNotOptimize(oss.str());
+    }
+}
+
+void BM_print_to_string(benchmark::State & state)
+{
+    std::string str;
+    while (state.KeepRunning()) {
+        str.clear();
+        yap::print_to(str, expr);
+        benchmark::DoNotOptimize(str.data());
+    }
+}
+
+void BM_print_to_string_compact(benchmark::State & state)
+{
+    std::string str;
+    yap::print_options options;
+    options.compact = true;
+    while (state.KeepRunning()) {
+        str.clear();
+        yap::print_to(str, expr, options);
+        benchmark::DoNotOptimize(str.data());
+    }
+}
+
+BENCHMARK(BM_print_ostream);
+BENCHMARK(BM_print_ostream_reused);
+BENCHMARK(BM_print_to_string);
+BENCHMARK(BM_print_to_string_compact);
+
+BENCHMARK_MAIN()
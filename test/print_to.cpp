@@ -0,0 +1,145 @@
+// Copyright (C) 2016-2018 T. Zachary Laine
+//
+// Distributed under the Boost Software License, Version 1.0. (See
+// accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+#include <boost/yap/expression.hpp>
+#include <boost/yap/print.hpp>
+
+#include <boost/test/minimal.hpp>
+
+#include <sstream>
+#include <vector>
+
+
+template<typename T>
+using term = boost::yap::terminal<boost::yap::expression, T>;
+
+namespace yap = boost::yap;
+namespace bh = boost::hana;
+
+
+struct thing
+{};
+
+struct streamable_thing
+{
+    int i;
+};
+
+std::ostream & operator<<(std::ostream & os, streamable_thing x)
+{
+    return os << "thing #" << x.i;
+}
+
+template<typename Expr>
+bool same_as_print(Expr const & expr)
+{
+    std::ostringstream oss;
+    yap::print(oss, expr);
+    std::string str;
+    yap::print_to(str, expr);
+    if (str != oss.str()) {
+        std::cerr << "print():\n"
+                  << oss.str() << "print_to():\n"
+                  << str << std::endl;
+        return false;
+    }
+    return true;
+}
+
+template<typename Expr>
+std::string compact(Expr const & expr)
+{
+    std::string str;
+    yap::print_options options;
+    options.compact = true;
+    return yap::print_to(str, expr, options);
+}
+
+int test_main(int, char * [])
+{
+    using namespace yap::literals;
+
+    term<double> unity{1.0};
+    term<int> i{-42};
+    term<unsigned long> ul{18446744073709551615ul};
+    term<bool> b{true};
+    term<char> c{'x'};
+    term<char const *> s{"str"};
+    term<std::string> str{std::string("a string")};
+    term<float> f{0.1f};
+    term<double> big{1.0e100};
+    term<double> precise{3.14159265358979};
+    term<thing> a_thing{bh::make_tuple(thing{})};
+    term<streamable_thing> a_streamable{bh::make_tuple(streamable_thing{7})};
+
+    {
+        BOOST_CHECK(same_as_print(unity));
+        BOOST_CHECK(same_as_print(i));
+        BOOST_CHECK(same_as_print(ul));
+        BOOST_CHECK(same_as_print(b));
+        BOOST_CHECK(same_as_print(c));
+        BOOST_CHECK(same_as_print(s));
+        BOOST_CHECK(same_as_print(str));
+        BOOST_CHECK(same_as_print(f));
+        BOOST_CHECK(same_as_print(big));
+        BOOST_CHECK(same_as_print(precise));
+        BOOST_CHECK(same_as_print(a_thing));
+        BOOST_CHECK(same_as_print(a_streamable));
+        BOOST_CHECK(same_as_print(1_p));
+        BOOST_CHECK(same_as_print(term<short>{-7}));
+        BOOST_CHECK(same_as_print(term<long long>{-9223372036854775807ll}));
+    }
+
+    {
+        BOOST_CHECK(same_as_print(unity + i));
+        BOOST_CHECK(same_as_print(-unity));
+        BOOST_CHECK(same_as_print(unity + 1));
+        BOOST_CHECK(same_as_print(1_p * 2_p - i));
+        BOOST_CHECK(same_as_print(unity(i, s, 3_p)));
+        BOOST_CHECK(same_as_print(a_thing[a_streamable]));
+        BOOST_CHECK(same_as_print(yap::if_else(b, unity, i)));
+
+        auto const const_expr = unity * i;
+        auto expr = const_expr + (f - term<int>{1});
+        BOOST_CHECK(same_as_print(expr));
+        BOOST_CHECK(same_as_print(expr / expr));
+        BOOST_CHECK(same_as_print(const_expr % std::move(expr)));
+        BOOST_CHECK(same_as_print(!-~(str + c)));
+    }
+
+    {
+        BOOST_CHECK(compact(unity) == "term<double>[=1]");
+        BOOST_CHECK(compact(1_p) == "term<boost::yap::placeholder<1ll>>[=1]");
+        BOOST_CHECK(
+            compact(unity + 1) ==
+            "expr<+>(term<double>[=1] &, term<int>[=1])");
+
+        auto const sum = i + 2;
+        BOOST_CHECK(
+            compact(sum * -unity) ==
+            "expr<*>(expr<+> const &(term<int>[=-42] &, term<int>[=2]), "
+            "expr<->(term<double>[=1] &))");
+        BOOST_CHECK(
+            compact(unity(i, s)) ==
+            "expr<()>(term<double>[=1] &, term<int>[=-42] &, "
+            "term<char const*>[=str] &)");
+    }
+
+    {
+        std::vector<char> buffer = {'>', ' '};
+        yap::print_options options;
+        options.indent = "\t";
+        yap::print_to(buffer, -(unity + 1), options);
+        std::string const str(buffer.begin(), buffer.end());
+        BOOST_CHECK(
+            str ==
+            "> expr<->\n"
+            "\texpr<+>\n"
+            "\t\tterm<double>[=1] &\n"
+            "\t\tterm<int>[=1]\n");
+    }
+
+    return 0;
+}
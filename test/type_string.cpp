@@ -0,0 +1,73 @@
+// Copyright (C) 2016-2018 T. Zachary Laine
+//
+// Distributed under the Boost Software License, Version 1.0. (See
+// accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt)
+#include <boost/yap/expression.hpp>
+#include <boost/yap/print.hpp>
+
+#include <boost/test/minimal.hpp>
+
+#include <cstring>
+
+
+template<typename T>
+using term = boost::yap::terminal<boost::yap::expression, T>;
+
+namespace yap = boost::yap;
+
+
+template<typename Expr>
+constexpr auto const & type_string_of(Expr const &)
+{
+    return yap::type_string_v<Expr>;
+}
+
+int test_main(int, char * [])
+{
+    using namespace yap::literals;
+
+    {
+        static_assert(yap::op_string(yap::expr_kind::plus)[0] == '+', "");
+
+        static_assert(yap::type_string_v<term<double>> == "term", "");
+        static_assert(yap::type_string_v<decltype(1_p)> == "1_p", "");
+        static_assert(yap::type_string_v<decltype(12_p)>.size() == 4, "");
+        static_assert(
+            yap::type_string_v<decltype(1_p + 2_p)> == "expr<+>(1_p, 2_p)",
+            "");
+        static_assert(
+            yap::type_string_v<decltype(-(1_p * term<int>{1}))> ==
+                "expr<->(expr<*>(1_p, term))",
+            "");
+
+        // cv-ref qualified expression types are the same as unqualified ones.
+        static_assert(
+            yap::type_string_v<term<double> const &> ==
+                yap::type_string_v<term<double>>,
+            "");
+    }
+
+    {
+        term<double> unity{1.0};
+        auto const sum = unity + 2_p;
+
+        BOOST_CHECK(type_string_of(sum) == "expr<+>(term &, 2_p)");
+        BOOST_CHECK(
+            type_string_of(sum * unity) ==
+            "expr<*>(expr<+> const &(term &, 2_p), term &)");
+        BOOST_CHECK(
+            type_string_of(unity(3_p, 1)) == "expr<()>(term &, 3_p, term)");
+        BOOST_CHECK(
+            type_string_of(yap::if_else(unity, 1_p, 2_p)) ==
+            "expr<?:>(term &, 1_p, 2_p)");
+
+        BOOST_CHECK(
+            std::strcmp(
+                type_string_of(unity[1]).c_str(), "expr<[]>(term &, term)") ==
+            0);
+        BOOST_CHECK(type_string_of(-unity) != "expr<->(term)");
+    }
+
+    return 0;
+}